@@ -0,0 +1,177 @@
+#include "Accumulator.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+Accumulator::Accumulator(int width_, int height_) : 
+	width(width_), height(height_), passes(0),
+	sum(size_t(width_) * height_), count(size_t(width_) * height_, 0),
+	estimates(size_t(width_) * height_, 0), 
+	mean(size_t(width_) * height_, 0.0), m2(size_t(width_) * height_, 0.0) {}
+
+void Accumulator::Add(int x, int y, const Color &radiance, int samples) {
+	const size_t i = size_t(y) * width + x;
+	sum[i] = sum[i] + radiance;
+	count[i] += samples;
+	
+	/* Welford update with the luminance of this estimate */
+	const Color estimate = radiance / samples;
+	const double l = 0.2126 * estimate.x + 0.7152 * estimate.y + 0.0722 * estimate.z;
+	estimates[i]++;
+	const double delta = l - mean[i];
+	mean[i] += delta / estimates[i];
+	m2[i] += delta * (l - mean[i]);
+}
+
+Color Accumulator::Mean(int x, int y) const {
+	const size_t i = size_t(y) * width + x;
+	return count[i] > 0 ? sum[i] / count[i] : Color();
+}
+
+/* Standard error of the mean luminance relative to the mean; dark
+   pixels are measured against 0.05 instead of their own mean, so
+   that small absolute noise counts as converged */
+double Accumulator::RelativeError(size_t i) const {
+	const uint32_t n = estimates[i];
+	if (n < 2)
+		return 1e30;
+	const double variance = m2[i] / (n - 1);
+	return sqrt(variance / n) / max(mean[i], 0.05);
+}
+
+uint64_t Accumulator::TotalSamples() const {
+	uint64_t total = 0;
+	for (uint32_t c : count)
+		total += c;
+	return total;
+}
+
+/* Marks the pixels whose relative error exceeds threshold. If these
+   are more than max_pixels, only the max_pixels noisiest ones are
+   marked. Returns the number of marked pixels. */
+size_t Accumulator::SelectNoisy(double threshold, size_t max_pixels, 
+                                vector<unsigned char> &active) const {
+	vector<pair<double, size_t>> noisy;
+	for (size_t i = 0; i < count.size(); i++) {
+		const double error = RelativeError(i);
+		if (error > threshold)
+			noisy.push_back(make_pair(error, i));
+	}
+	
+	if (noisy.size() > max_pixels) {
+		nth_element(noisy.begin(), noisy.begin() + max_pixels, noisy.end(),
+		            [](const pair<double, size_t> &a, const pair<double, size_t> &b) {
+		                return a.first > b.first || (a.first == b.first && a.second < b.second);
+		            });
+		noisy.resize(max_pixels);
+	}
+	
+	fill(active.begin(), active.end(), 0);
+	for (const pair<double, size_t> &p : noisy)
+		active[p.second] = 1;
+	return noisy.size();
+}
+
+void Accumulator::Resolve(Image &img) const {
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+			img.setColor(x, y, Mean(x, y));
+}
+
+/* Debug image of the samples per pixel, scaled to the maximum count */
+void Accumulator::SampleMap(Image &img) const {
+	const uint32_t max_count = max(1u, *max_element(count.begin(), count.end()));
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			const double v = double(count[size_t(y) * width + x]) / max_count;
+			img.setColor(x, y, Color(v, v, v));
+		}
+	}
+}
+
+/*------------------------------------------------------------------
+| Checkpoint file: header (magic, width, height, passes), followed
+| by the radiance sums (three doubles per pixel), the sample counts,
+| and the Welford state (estimates, mean, m2). Written to a
+| temporary file that replaces the old checkpoint only when
+| complete, so an interrupted write never destroys the last
+| checkpoint.
+------------------------------------------------------------------*/
+
+static const char CHECKPOINT_MAGIC[8] = { 'P', 'T', 'C', 'K', 'P', 'T', '0', '2' };
+
+struct CheckpointHeader {
+	char magic[8];
+	int32_t width, height, passes;
+};
+
+bool Accumulator::SaveCheckpoint(const string &filename) const {
+	CheckpointHeader header;
+	memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.width = width;
+	header.height = height;
+	header.passes = passes;
+	
+	const string temp = filename + ".tmp";
+	FILE *f = fopen(temp.c_str(), "wb");
+	if (!f) {
+		cerr << "Could not write checkpoint " << temp << endl;
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+	          fwrite(sum.data(), sizeof(Color), sum.size(), f) == sum.size() &&
+	          fwrite(count.data(), sizeof(uint32_t), count.size(), f) == count.size() &&
+	          fwrite(estimates.data(), sizeof(uint32_t), estimates.size(), f) == estimates.size() &&
+	          fwrite(mean.data(), sizeof(double), mean.size(), f) == mean.size() &&
+	          fwrite(m2.data(), sizeof(double), m2.size(), f) == m2.size();
+	ok = fclose(f) == 0 && ok;
+	
+	if (!ok || rename(temp.c_str(), filename.c_str()) != 0) {
+		cerr << "Could not write checkpoint " << filename << endl;
+		remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool Accumulator::LoadCheckpoint(const string &filename) {
+	FILE *f = fopen(filename.c_str(), "rb");
+	if (!f) {
+		cerr << "Could not open checkpoint " << filename << endl;
+		return false;
+	}
+	
+	CheckpointHeader header;
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+	    memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0) {
+		cerr << filename << " is not a checkpoint" << endl;
+		fclose(f);
+		return false;
+	}
+	if (header.width != width || header.height != height) {
+		cerr << "Checkpoint " << filename << " has size " << header.width << "x" 
+		     << header.height << ", expected " << width << "x" << height << endl;
+		fclose(f);
+		return false;
+	}
+	
+	const bool ok = fread(sum.data(), sizeof(Color), sum.size(), f) == sum.size() &&
+	                fread(count.data(), sizeof(uint32_t), count.size(), f) == count.size() &&
+	                fread(estimates.data(), sizeof(uint32_t), estimates.size(), f) == estimates.size() &&
+	                fread(mean.data(), sizeof(double), mean.size(), f) == mean.size() &&
+	                fread(m2.data(), sizeof(double), m2.size(), f) == m2.size();
+	fclose(f);
+	if (!ok) {
+		cerr << "Checkpoint " << filename << " is truncated" << endl;
+		fill(sum.begin(), sum.end(), Color());
+		fill(count.begin(), count.end(), 0);
+		fill(estimates.begin(), estimates.end(), 0);
+		fill(mean.begin(), mean.end(), 0.0);
+		fill(m2.begin(), m2.end(), 0.0);
+		return false;
+	}
+	passes = header.passes;
+	return true;
+}
@@ -0,0 +1,40 @@
+#ifndef _ACCUMULATOR_H_
+#define _ACCUMULATOR_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Structs.hpp"
+
+using namespace std;
+
+/* Unclamped radiance sum and number of samples of every pixel,
+   filled in passes over the image. Every Add() is one estimate of the
+   pixel; mean and variance of the luminance of these estimates are
+   tracked with Welford's method to find pixels that need more
+   samples. The state after a pass can be saved to a binary
+   checkpoint file and restored from it. */
+struct Accumulator {
+	int width, height;
+	int passes;				/* Number of completed passes */
+	vector<Color> sum;
+	vector<uint32_t> count;
+	vector<uint32_t> estimates;	/* Number of Add() calls per pixel */
+	vector<double> mean, m2;	/* Welford mean and sum of squared deviations */
+	
+	Accumulator(int width_, int height_);
+	
+	void Add(int x, int y, const Color &radiance, int samples);
+	Color Mean(int x, int y) const;
+	double RelativeError(size_t i) const;
+	uint64_t TotalSamples() const;
+	size_t SelectNoisy(double threshold, size_t max_pixels, vector<unsigned char> &active) const;
+	void Resolve(Image &img) const;
+	void SampleMap(Image &img) const;
+	
+	bool SaveCheckpoint(const string &filename) const;
+	bool LoadCheckpoint(const string &filename);
+};
+
+#endif // _ACCUMULATOR_H_
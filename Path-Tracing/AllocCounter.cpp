@@ -0,0 +1,32 @@
+#include "AllocCounter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+/*------------------------------------------------------------------
+| Replacement of the global allocation functions that counts every
+| heap allocation of the program. Array forms fall back to these.
+------------------------------------------------------------------*/
+
+static std::atomic<size_t> allocations(0);
+
+size_t allocationCount() {
+	return allocations.load();
+}
+
+void *operator new(size_t size) {
+	allocations++;
+	void *p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
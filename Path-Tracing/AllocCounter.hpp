@@ -0,0 +1,10 @@
+#ifndef _ALLOCCOUNTER_H_
+#define _ALLOCCOUNTER_H_
+
+#include <cstddef>
+
+/* Number of heap allocations made through operator new so far.
+   Used by the benchmark to verify allocation-free shading. */
+size_t allocationCount();
+
+#endif // _ALLOCCOUNTER_H_
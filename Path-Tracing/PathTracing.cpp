@@ -26,9 +26,19 @@
 #include <cstdlib> 
 #include <iostream>
 #include <fstream>
+#include <chrono>
+#include <omp.h>
 
 #include "Structs.hpp"
 #include "OBJReader.hpp"
+#include "BVH.hpp"
+#include "TriangleKernel.hpp"
+#include "TileScheduler.hpp"
+#include "Random.hpp"
+#include "Accumulator.hpp"
+#ifdef COUNT_ALLOCATIONS
+#include "AllocCounter.hpp"
+#endif
 
 using namespace std;
 
@@ -64,33 +74,21 @@ vector<Triangle> tris = {
 vector<Triangle> box = 
 	scaleOBJ(loadOBJ("deer.obj", Color(1, 1.0, 1.0)*0.999, GLOS), 0.05);
 
+/* Shading data of the triangles (parallel normal and material arrays)
+   and the bounding volume hierarchy over spheres and triangles, whose
+   packets hold the intersection data; both are built in main() */
+TriangleArrays tri_arrays;
+BVH bvh;
+
 /******************************************************************
 * Check for closest intersection of a ray with the scene.
 * Returns true if intersection is found, as well as ray parameter
 * of intersection and id of intersected object.
+* Traverses the BVH, so cost per ray is logarithmic in the number
+* of scene objects.
 *******************************************************************/
 bool intersectScene(const Ray &ray, double &t, size_t &id, Type &type) {
-    t = 1e20;
-	
-	/* Check for intersection with spheres in scene. */
-    for (size_t i = 0; i < spheres.size(); i ++) {
-        double d = spheres[i].Intersect(ray);
-        if (d > 0.0  && d < t) {
-            t = d;
-            id = i;
-            type = SPH;
-        }
-    }
-    /* Check for intersection with triangles in scene. */
-    for (size_t i = 0; i < tris.size(); i ++) {
-        double d = tris[i].intersect(ray);
-        if (d > 0.0 && d < t) {
-            t  = d;
-            id = i;
-            type = TRI;
-        }
-    }
-    return t < 1e20;
+    return bvh.Intersect(ray, t, id, type);
 }
 
 /******************************************************************
@@ -98,15 +96,15 @@ bool intersectScene(const Ray &ray, double &t, size_t &id, Type &type) {
 * an angle. Used for computation of glossy and translucent 
 * materials in Radiance function.
 *******************************************************************/
-Vector sampleVector(Vector vec, double max_angle) {
+Vector sampleVector(Vector vec, double max_angle, RNG &rng) {
 	Vector sw = vec;
 	Vector su = fabs(sw.x) > 0.1 ? Vector(0.0, 1.0, 0.0) : Vector(1.0, 0.0, 0.0);
 	su = (su.Cross(sw)).Normalized();
 	Vector sv = sw.Cross(su);
 	
 	double cos_a_max = max_angle;
-	double eps1 = drand48();
-	double eps2 = drand48();
+	double eps1 = rng.Next();
+	double eps2 = rng.Next();
 	double cos_a = 1.0 - eps1 + eps1 * cos_a_max;
 	double sin_a = sqrt(1.0 - cos_a * cos_a);
 	double phi = 2.0*M_PI * eps2;
@@ -117,10 +115,18 @@ Vector sampleVector(Vector vec, double max_angle) {
 }
 
 /******************************************************************
-* Recursive path tracing for computing radiance via Monte-Carlo
-* integration, considering diffuse, specular, glossy, transparent
-* or translucent material.
-* After 5 bounces Russian Roulette is used to possibly terminate rays. 
+* Path tracing for computing radiance via Monte-Carlo integration,
+* considering diffuse, specular, glossy, transparent or translucent
+* material.
+* Paths are traced iteratively: each bounce multiplies the path
+* throughput by the surface color and continues with the next ray;
+* the hit is shaded by the BSDF kernel of its material (see Shade).
+* On transparent and translucent surfaces hit before SPLIT_DEPTH the
+* path is split into a reflected and a transmitted path; the second
+* one waits on a small fixed-size stack (splitting budget). Deeper,
+* one of both is chosen randomly.
+* After rr_depth bounces Russian Roulette is used to possibly terminate
+* paths, after max_depth bounces paths are terminated.
 * Emitted light from light source only included on first direct hit.
 * On diffuse surfaces light sources are explicitely sampled.
 * For transparent and translucent objects, Schlick�s approximation
@@ -128,188 +134,167 @@ Vector sampleVector(Vector vec, double max_angle) {
 * A more detailed explaination is to be found in the README.
 *******************************************************************/
 
-Color Radiance(const Ray &ray, int depth, int E, bool thinLense) {
-    depth++;
-    
-    double aperture = 30;
-    double focal_length = 60;
+#define SPLIT_DEPTH 3
+#define PATH_STACK_SIZE 8
 
-    double t;                               
-    size_t id = 0; 
-    Type description_type; 
-    
-    if (!intersectScene(ray, t, id, description_type)) {
-        return Color(0.0, 0.0, 0.0); 
-	}
-	
-	bool isSphere = description_type == SPH ? true : false;
-	
-	Sphere obj_s = isSphere ? spheres[id] : spheres[0];
-	Triangle obj_t = isSphere ? tris[0] : tris[id];
-	
-	Color col = isSphere ? obj_s.color : obj_t.color;
+/* Maximum number of bounces and bounce after which Russian Roulette starts */
+int max_depth = 64;
+int rr_depth = 5;
 
-	/* Intersection point */
-    Vector hitpoint = ray.org + ray.dir * t;
-    
-    /* Calculate normals. */
-    Vector normal = isSphere ? (hitpoint - obj_s.position).Normalized() : obj_t.normal;
-    Vector nl = normal;
-    if (normal.Dot(ray.dir) >= 0) 
-        nl = nl.Invert(); 
+/* Path segment waiting to be traced */
+struct PathState {
+    Vector org, dir;        /* Ray of the segment */
+    Color throughput;       /* Weight of radiance arriving along the ray */
+    int depth;              /* Number of bounces before the segment */
+    int E;                  /* Include emission of the next hit */
+};
+
+/* Path state at a surface hit, read and updated by the BSDF kernels;
+   a kernel adds the radiance of the hit, weights the throughput and
+   sets the ray along which the path continues */
+struct ShadingContext {
+    Ray &ray;                   /* In: incoming ray, out: next ray */
+    const HitRecord &hit;
+    const Vector &hitpoint;
+    const Vector &nl;           /* Normal facing the incoming ray */
+    const Color &col;           /* Color, scaled by Russian Roulette */
+    Color &radiance;
+    Color &throughput;
+    int depth;
+    int &E;
+    PathState *stack;           /* Split paths, see SPLIT_DEPTH */
+    int &stack_size;
+    RNG &rng;
+};
+
+/******************************************************************
+* BSDF kernels: one specialization of Shade per material, so every
+* kernel is compiled without material tests. They are collected in
+* shade_kernels (indexed by Refl_t), and Radiance() jumps to the
+* kernel of the hit material once per bounce.
+*******************************************************************/
+
+template <Refl_t R>
+void Shade(ShadingContext &c);
+
+/**
+ * Object is diffuse.
+ **/
+template <>
+void Shade<DIFF>(ShadingContext &c) {
+    /* Compute random reflection vector on hemisphere */
+    double r1 = 2.0 * M_PI * c.rng.Next(); 
+    double r2 = c.rng.Next(); 
+    double r2s = sqrt(r2); 
     
-    /* Calculation for Thin-Lense Depth of Filed. */
-	if (depth == 1 && thinLense == true) {
-		Vector focal_point = ray.org - Vector(0.0, 0.0, focal_length);
-		/* Check if hitpoint is outside DOF */
-		if (hitpoint.z < (focal_point.z - aperture) || (focal_point.z + aperture) < hitpoint.z) {
-			/* https://en.wikipedia.org/wiki/Circle_of_confusion */
-			double obj_dis = fabs(hitpoint.z - ray.org.z);
-			double img_dis = focal_length * obj_dis / (obj_dis - focal_length);
-			double focus_obj_dis = focal_length * img_dis / (img_dis - focal_length);
-			double m = img_dis / focus_obj_dis;
-			double C = aperture * fabs(obj_dis - focus_obj_dis) / obj_dis;
-			double c = C * m;
-			double N = focal_length / aperture;
-			double dof = 2 * N * c * (m + 1) / (pow(m, 2) - pow(N * c / focal_length, 2));
-			
-			/* Determine blur factor. */
-			Vector dof_border = hitpoint.z < (focal_point.z - aperture) ?
-				Vector(focal_point.x, focal_point.y, focal_point.z - aperture) :
-				Vector(focal_point.x, focal_point.y, focal_point.z + aperture);
-				
-			double blur_factor = (dof_border - hitpoint).Length() + dof;
-			
-			double cos_a_max = cos(0.005 + (blur_factor*0.00018));
-			Vector l = sampleVector(ray.dir, cos_a_max);
-			
-			return Radiance(Ray(ray.org, l), depth-1, E, false);
-		}
-	}
-
-    /* Maximum RGB reflectivity for Russian Roulette */
-    double p = col.Max();
-    if (depth > 5 || !p) {  /* After 5 bounces or if max reflectivity is zero */
-	
-        if (drand48() < p)            /* Russian Roulette */
-            col = col * (1/p);        /* Scale estimator to remain unbiased */
-        else 
-			/* No further bounces, only return potential emission */
-            return (isSphere ? obj_s.emission : obj_t.emission) * E;  
-     }
-
-	/**
-	 * Object is diffuse.
-	 **/
-    if ((isSphere ? obj_s.refl : obj_t.refl) == DIFF) {
-			                  
-        /* Compute random reflection vector on hemisphere */
-        double r1 = 2.0 * M_PI * drand48(); 
-        double r2 = drand48(); 
-        double r2s = sqrt(r2); 
+    /* Set up local orthogonal coordinate system u,v,w on surface */
+    const Vector &w = c.nl; 
+    Vector u = fabs(w.x) > 0.1 ? Vector(0.0, 1.0, 0.0) : Vector(1.0, 0.0, 0.0); 
+    u = (u.Cross(w)).Normalized();
+    Vector v = w.Cross(u);  
+
+    /* Random reflection vector d */
+    Vector d = (u * cos(r1) * r2s + 
+                v * sin(r1) * r2s + 
+                w * sqrt(1 - r2)).Normalized();  
+
+    /** Explicit computation of direct lighting **/
+    Vector e;
+    for (size_t i = 0; i < spheres.size(); i ++) {
         
-        /* Set up local orthogonal coordinate system u,v,w on surface */
-        Vector w = nl; 
-        Vector u = fabs(w.x) > 0.1 ? Vector(0.0, 1.0, 0.0) : Vector(1.0, 0.0, 0.0); 
-        u = (u.Cross(w)).Normalized();
-        Vector v = w.Cross(u);  
-
-        /* Random reflection vector d */
-        Vector d = (u * cos(r1) * r2s + 
-                    v * sin(r1) * r2s + 
-                    w * sqrt(1 - r2)).Normalized();  
-
-        /** Explicit computation of direct lighting **/
-        Vector e;
-        for (size_t i = 0; i < spheres.size(); i ++) {
-			
-            Sphere sphere = spheres[i];
-            if (sphere.emission.x <= 0 && sphere.emission.y <= 0 && sphere.emission.z <= 0
-				&& !isSphere) 
-                continue; /* Skip objects that are not light sources */
-      
-            /* Randomly sample spherical light source from surface intersection */
-            /* Create random sample direction l towards spherical light source */
-            double cos_a_max = sqrt(1.0 - sphere.radius * sphere.radius / 
-                               (hitpoint - sphere.position).Dot(hitpoint-sphere.position));
-            cos_a_max = cos_a_max != cos_a_max ? 1 : cos_a_max;
-            
-            Vector l = sampleVector(sphere.position - hitpoint,	cos_a_max);
-
-            /* Shoot shadow ray, check if intersection is with light source */
-            size_t index = id;
-            double t_;
-            Type temp_type;
-            if (intersectScene(Ray(hitpoint,l), t_, index, temp_type) && index == i) {
-					  
-                double omega = 2*M_PI * (1 - cos_a_max);
-
-                /* Add diffusely reflected light from light source; note constant BRDF 1/PI */
-                e = e + col.MultComponents(sphere.emission * l.Dot(nl) * omega) / M_PI; 
-            }
+        const Sphere &sphere = spheres[i];
+        if (sphere.emission.x <= 0 && sphere.emission.y <= 0 && sphere.emission.z <= 0
+            && c.hit.type != SPH) 
+            continue; /* Skip objects that are not light sources */
+  
+        /* Randomly sample spherical light source from surface intersection */
+        /* Create random sample direction l towards spherical light source */
+        double cos_a_max = sqrt(1.0 - sphere.radius * sphere.radius / 
+                           (c.hitpoint - sphere.position).Dot(c.hitpoint - sphere.position));
+        cos_a_max = cos_a_max != cos_a_max ? 1 : cos_a_max;
+        
+        Vector l = sampleVector(sphere.position - c.hitpoint, cos_a_max, c.rng);
+
+        /* Shoot shadow ray, check if light source is hit and unoccluded */
+        Ray shadow_ray(c.hitpoint, l);
+        double t_light = sphere.Intersect(shadow_ray);
+        if (t_light > 0.0 && !bvh.Occluded(shadow_ray, t_light)) {
+                  
+            double omega = 2*M_PI * (1 - cos_a_max);
+
+            /* Add diffusely reflected light from light source; note constant BRDF 1/PI */
+            e = e + c.col.MultComponents(sphere.emission * l.Dot(c.nl) * omega) / M_PI; 
         }
-        /* Return potential light emission, direct lighting, and indirect lighting (via
-           recursive call for Monte-Carlo integration */      
-        return (isSphere ? obj_s.emission : obj_t.emission)
-			* E + e + col.MultComponents(Radiance(Ray(hitpoint,d), depth, 0, false));
-	
-	/**
-	 * Object is mirror like. Perfect specular reflection.
-	 **/
-    } else if ((isSphere ? obj_s.refl : obj_t.refl) == SPEC) {  
-        /* Return light emission mirror reflection (via recursive call using perfect
-           reflection vector) */
-        return (isSphere ? obj_s.emission : obj_t.emission) + 
-            col.MultComponents(Radiance(Ray(hitpoint, ray.dir - normal * 2 * normal.Dot(ray.dir)),
-			depth, 1, false));
-	
-	/**
-	 * Object is glossy. Non perfect reflection, due to distributed rays about the
-	 * specular reflection direction.
-	 **/
-    } else if ((isSphere ? obj_s.refl : obj_t.refl) == GLOS) {
-		Vector l = sampleVector(ray.dir - normal * 2 * normal.Dot(ray.dir), cos(0.15));
-		
-		return (isSphere ? obj_s.emission : obj_t.emission) + 
-            col.MultComponents(Radiance(Ray(hitpoint, l), depth, 1, false));   
-	}
-
-    /** 
-     * Otherwise object transparent or translucent, i.e. assumed dielectric glass material. 
-     **/
-    Ray reflRay (hitpoint, ray.dir - normal * 2 * normal.Dot(ray.dir));  
-    bool into = normal.Dot(nl) > 0;
+    }
+    /* Add potential light emission and direct lighting, continue with
+       indirect lighting (Monte-Carlo integration) */      
+    c.radiance = c.radiance + c.throughput.MultComponents(c.hit.emission * c.E + e);
+    c.throughput = c.throughput.MultComponents(c.col);
+    c.ray = Ray(c.hitpoint, d);
+    c.E = 0;
+}
+
+/* All other materials add their emission and reflect at least once more */
+static inline Vector ReflectAndAttenuate(ShadingContext &c) {
+    c.radiance = c.radiance + c.throughput.MultComponents(c.hit.emission);
+    c.throughput = c.throughput.MultComponents(c.col);
+    c.E = 1;
+    return c.ray.dir - c.hit.normal * 2 * c.hit.normal.Dot(c.ray.dir);
+}
+
+/**
+ * Object is mirror like. Perfect specular reflection.
+ **/
+template <>
+void Shade<SPEC>(ShadingContext &c) {
+    c.ray = Ray(c.hitpoint, ReflectAndAttenuate(c));
+}
+
+/**
+ * Object is glossy. Non perfect reflection, due to distributed rays about the
+ * specular reflection direction.
+ **/
+template <>
+void Shade<GLOS>(ShadingContext &c) {
+    c.ray = Ray(c.hitpoint, sampleVector(ReflectAndAttenuate(c), cos(0.15), c.rng));
+}
+
+/** 
+ * Object transparent or translucent, i.e. assumed dielectric glass material;
+ * translucent objects sample the transmittance and reflectance vectors.
+ **/
+template <bool translucent>
+static inline void ShadeDielectric(ShadingContext &c) {
+    const Vector &normal = c.hit.normal;
+    const Vector &dir = c.ray.dir;
+    Vector refl_dir = ReflectAndAttenuate(c);
+    bool into = normal.Dot(c.nl) > 0;
     double nc = 1;                        /* Index of refraction of air (approximately) */  
     double nt = 1.5;                      /* Index of refraction of glass (approximately) */
 
     double nnt = into ? nc/nt : nt/nc;
-    double ddn = ray.dir.Dot(nl);
+    double ddn = dir.Dot(c.nl);
     double cos2t = 1 - nnt * nnt * (1 - ddn*ddn);
 
     /* Determine transmitted ray direction for refraction */    
     Vector tdir = into ?
-        (ray.dir * nnt - normal * (ddn * nnt + sqrt(cos2t))) :
-		(ray.dir * nnt + normal * (ddn * nnt + sqrt(cos2t)));
-		
-	/* Determine sampled transmittance and reflectance vectors for translucency. */
-	Vector sampled_tdir;
-	Vector sampled_spec;
-	if ((isSphere ? obj_s.refl : obj_t.refl) == TRSL) {
-		sampled_tdir = sampleVector(tdir, cos(0.25));
-		sampled_spec = sampleVector(ray.dir - normal * 2 * normal.Dot(ray.dir), cos(0.125));
-	}
-	
-	/* Check for total internal reflection, if so only reflect */
+        (dir * nnt - normal * (ddn * nnt + sqrt(cos2t))) :
+        (dir * nnt + normal * (ddn * nnt + sqrt(cos2t)));
+        
+    /* Determine sampled transmittance and reflectance vectors for translucency;
+       Fresnel is still evaluated for the unperturbed transmitted direction */
+    Vector sampled_tdir;
+    if (translucent) {
+        sampled_tdir = sampleVector(tdir, cos(0.25), c.rng);
+        refl_dir = sampleVector(refl_dir, cos(0.125), c.rng);
+    }
+    
+    /* Check for total internal reflection, if so only reflect */
     if (cos2t < 0) { 
-		if ((isSphere ? obj_s.refl : obj_t.refl) == TRSL) {
-			return (isSphere ? obj_s.emission : obj_t.emission)
-				+ col.MultComponents(Radiance(Ray(hitpoint, sampled_spec), depth, 1, false));
-		} else {
-			return (isSphere ? obj_s.emission : obj_t.emission)
-				+ col.MultComponents(Radiance(reflRay, depth, 1, false));
-		}
-	}
-	
+        c.ray = Ray(c.hitpoint, refl_dir);
+        return;
+    }
+    
     /* Determine R0 for Schlick�s approximation */
     double a = nt - nc;
     double b = nt + nc;
@@ -317,75 +302,469 @@ Color Radiance(const Ray &ray, int depth, int E, bool thinLense) {
   
     /* Cosine of correct angle depending on outside/inside */
     tdir = tdir.Normalized();
-    double c = into ? (1 + ddn) : (1 - tdir.Dot(normal));
-	
+    double cos_t = into ? (1 + ddn) : (1 - tdir.Dot(normal));
+    
     /* Compute Schlick�s approximation of Fresnel equation */ 
-    double Re = R0 + (1 - R0) *c*c*c*c*c;   /* Reflectance */
-    double Tr = 1 - Re;                     /* Transmittance */
-	
+    double Re = R0 + (1 - R0) *cos_t*cos_t*cos_t*cos_t*cos_t;   /* Reflectance */
+    double Tr = 1 - Re;                                       /* Transmittance */
+
+    if (translucent)
+        tdir = sampled_tdir;
+
+    /* Split path near the camera: reflected path waits on the stack */
+    if (c.depth < SPLIT_DEPTH && c.stack_size < PATH_STACK_SIZE) {
+        PathState &reflected = c.stack[c.stack_size++];
+        reflected.org = c.hitpoint;
+        reflected.dir = refl_dir;
+        reflected.throughput = c.throughput * Re;
+        reflected.depth = c.depth;
+        reflected.E = 1;
+
+        c.throughput = c.throughput * Tr;
+        c.ray = Ray(c.hitpoint, tdir);
+        return;
+    }
+    
     /* Probability for selecting reflectance or transmittance */
     double P = .25 + .5 * Re;
     double RP = Re / P;         /* Scaling factors for unbiased estimator */
     double TP = Tr / (1 - P);
     
-    if ((isSphere ? obj_s.refl : obj_t.refl) == TRSL) {
-		/* Translucency */
-		if (depth >= 3) {
-			if (drand48() < P)
-				return (isSphere ? obj_s.emission : obj_t.emission)
-					+ col.MultComponents(Radiance(Ray(hitpoint, sampled_spec),
-					depth, 1, false) * RP);
-			else
-				return (isSphere ? obj_s.emission : obj_t.emission)
-					+ col.MultComponents(Radiance(Ray(hitpoint,sampled_tdir),
-					depth, 1, false) * TP);
-		}
-		return (isSphere ? obj_s.emission : obj_t.emission) + 
-            col.MultComponents(Radiance(Ray(hitpoint, sampled_tdir), depth, 1, false) * Tr +
-            Radiance(Ray(hitpoint, sampled_spec), depth, 1, false) * Re);
-		
-	} else {
-		/* Transparancy */
-		if (depth < 3) {  
-			return (isSphere ? obj_s.emission : obj_t.emission)
-				+ col.MultComponents(Radiance(reflRay, depth, 1, false) * Re + 
-				Radiance(Ray(hitpoint, tdir), depth, 1, false) * Tr);
-		
-		} else {
-			if (drand48() < P)
-				return (isSphere ? obj_s.emission : obj_t.emission)
-					+ col.MultComponents(Radiance(reflRay, depth, 1, false) * RP);
-			else
-				return (isSphere ? obj_s.emission : obj_t.emission)
-					+ col.MultComponents(Radiance(Ray(hitpoint,tdir), depth, 1, false) * TP);
-		}
-	}
+    if (c.rng.Next() < P) {
+        c.throughput = c.throughput * RP;
+        c.ray = Ray(c.hitpoint, refl_dir);
+    } else {
+        c.throughput = c.throughput * TP;
+        c.ray = Ray(c.hitpoint, tdir);
+    }
+}
+
+template <>
+void Shade<REFR>(ShadingContext &c) {
+    ShadeDielectric<false>(c);
+}
+
+template <>
+void Shade<TRSL>(ShadingContext &c) {
+    ShadeDielectric<true>(c);
+}
+
+/* Kernel of each Refl_t; the thin-film materials have no film model
+   in this renderer, scenes using them are rejected by CheckMaterials() */
+typedef void (*ShadeKernel)(ShadingContext &c);
+
+static const ShadeKernel shade_kernels[] = {
+    Shade<DIFF>,        /* DIFF */
+    Shade<SPEC>,        /* SPEC */
+    Shade<REFR>,        /* REFR */
+    Shade<GLOS>,        /* GLOS */
+    Shade<TRSL>,        /* TRSL */
+    nullptr,            /* OFILM */
+    nullptr,            /* SFILM */
+};
+static_assert(sizeof(shade_kernels) / sizeof(shade_kernels[0]) == SFILM + 1,
+              "One shading kernel per material");
+
+/* True if every object of the scene has a shading kernel */
+bool CheckMaterials() {
+    for (size_t i = 0; i < spheres.size(); i ++) {
+        if (!shade_kernels[spheres[i].refl]) {
+            cerr << "Sphere " << i << " has a thin-film material, which only "
+                 << "Thin-Film-Interference renders" << endl;
+            return false;
+        }
+    }
+    for (size_t i = 0; i < tris.size(); i ++) {
+        if (!shade_kernels[tris[i].refl]) {
+            cerr << "Triangle " << i << " has a thin-film material, which only "
+                 << "Thin-Film-Interference renders" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+Color Radiance(const Ray &camera_ray, bool thinLense, RNG &rng) {
+    double aperture = 30;
+    double focal_length = 60;
+
+    Color radiance;
+
+    PathState stack[PATH_STACK_SIZE];
+    int stack_size = 1;
+    stack[0].org = camera_ray.org;
+    stack[0].dir = camera_ray.dir;
+    stack[0].throughput = Color(1.0, 1.0, 1.0);
+    stack[0].depth = 0;
+    stack[0].E = 1;
+
+    while (stack_size > 0) {
+        const PathState &state = stack[--stack_size];
+        Ray ray(state.org, state.dir);
+        Color throughput = state.throughput;
+        int depth = state.depth;
+        int E = state.E;
+
+        for (;;) {
+            depth++;
+
+            double t;                               
+            size_t id = 0; 
+            Type description_type; 
+            
+            if (!intersectScene(ray, t, id, description_type))
+                break;
+            
+            bool isSphere = description_type == SPH ? true : false;
+
+            /* Intersection point */
+            Vector hitpoint = ray.org + ray.dir * t;
+            
+            /* Hit object is referenced, not copied */
+            const HitRecord hit = isSphere ? HitRecord(spheres[id], id, hitpoint) :
+                                             HitRecord(tri_arrays, id);
+            
+            Color col = hit.color;
+            
+            /* Calculate normals. */
+            const Vector &normal = hit.normal;
+            Vector nl = normal;
+            if (normal.Dot(ray.dir) >= 0) 
+                nl = nl.Invert(); 
+            
+            /* Calculation for Thin-Lense Depth of Filed. */
+            if (depth == 1 && thinLense == true) {
+                thinLense = false;
+                Vector focal_point = ray.org - Vector(0.0, 0.0, focal_length);
+                /* Check if hitpoint is outside DOF */
+                if (hitpoint.z < (focal_point.z - aperture) || (focal_point.z + aperture) < hitpoint.z) {
+                    /* https://en.wikipedia.org/wiki/Circle_of_confusion */
+                    double obj_dis = fabs(hitpoint.z - ray.org.z);
+                    double img_dis = focal_length * obj_dis / (obj_dis - focal_length);
+                    double focus_obj_dis = focal_length * img_dis / (img_dis - focal_length);
+                    double m = img_dis / focus_obj_dis;
+                    double C = aperture * fabs(obj_dis - focus_obj_dis) / obj_dis;
+                    double c = C * m;
+                    double N = focal_length / aperture;
+                    double dof = 2 * N * c * (m + 1) / (pow(m, 2) - pow(N * c / focal_length, 2));
+                    
+                    /* Determine blur factor. */
+                    Vector dof_border = hitpoint.z < (focal_point.z - aperture) ?
+                        Vector(focal_point.x, focal_point.y, focal_point.z - aperture) :
+                        Vector(focal_point.x, focal_point.y, focal_point.z + aperture);
+                        
+                    double blur_factor = (dof_border - hitpoint).Length() + dof;
+                    
+                    /* Replace the camera ray by a blurred one and trace it instead */
+                    double cos_a_max = cos(0.005 + (blur_factor*0.00018));
+                    ray = Ray(ray.org, sampleVector(ray.dir, cos_a_max, rng));
+                    depth--;
+                    continue;
+                }
+            }
+
+            /* Terminate path, only add potential emission */
+            if (depth > max_depth) {
+                radiance = radiance + throughput.MultComponents(hit.emission * E);
+                break;
+            }
+
+            /* Maximum RGB reflectivity for Russian Roulette */
+            double p = col.Max();
+            if (depth > rr_depth || !p) {  /* After rr_depth bounces or if max reflectivity is zero */
+            
+                if (rng.Next() < p)            /* Russian Roulette */
+                    col = col * (1/p);        /* Scale estimator to remain unbiased */
+                else {
+                    /* No further bounces, only add potential emission */
+                    radiance = radiance + throughput.MultComponents(hit.emission * E);
+                    break;
+                }
+            }
+
+            /* One jump per hit to the kernel of the material */
+            ShadingContext context = { ray, hit, hitpoint, nl, col, radiance, throughput,
+                                       depth, E, stack, stack_size, rng };
+            shade_kernels[hit.refl](context);
+        }
+    }
+
+    return radiance;
+}
+
+
+/******************************************************************
+* Microbenchmark of the triangle intersection kernels: Random rays
+* are tested against all scene triangles packed into SIMD packets,
+* once per instruction set supported by the CPU. Reports Mrays/s
+* and checks the hits against the scalar triangle test.
+*******************************************************************/
+
+void benchmarkKernels() {
+    const int num_rays = 20000;
+
+    vector<TrianglePacket> packets((tris.size() + PACKET_WIDTH - 1) / PACKET_WIDTH);
+    for (size_t i = 0; i < tris.size(); i ++)
+        packets[i / PACKET_WIDTH].Set(i % PACKET_WIDTH, tris[i].a, tris[i].edge_a, 
+                                      tris[i].edge_b, i);
+
+    /* Random rays from inside the box, reference hits of the scalar test */
+    vector<Ray> rays;
+    vector<double> reference;
+    RNG rng(42);
+    for (int r = 0; r < num_rays; r ++) {
+        Vector org(rng.Next() * 100.0, rng.Next() * 80.0, rng.Next() * 170.0);
+        Vector dir = Vector(rng.Next() - 0.5, rng.Next() - 0.5, rng.Next() - 0.5).Normalized();
+        rays.push_back(Ray(org, dir));
+
+        double t = 1e20;
+        for (size_t i = 0; i < tris.size(); i ++) {
+            double d = tris[i].intersect(rays.back());
+            if (d > 0.0 && d < t)
+                t = d;
+        }
+        reference.push_back(t);
+    }
+
+    cout << "Triangle kernels (" << tris.size() << " triangles, " 
+         << num_rays << " rays):" << endl;
+
+    const KernelIsa isas[] = { ISA_SCALAR, ISA_SSE4, ISA_AVX2 };
+    for (KernelIsa isa : isas) {
+        if (!KernelSupported(isa))
+            continue;
+        PacketKernel kernel = GetPacketKernel(isa);
+
+        int mismatches = 0;
+        auto start = chrono::steady_clock::now();
+        for (int r = 0; r < num_rays; r ++) {
+            double t = 1e20;
+            for (const TrianglePacket &packet : packets)
+                kernel(packet, rays[r], t);
+            if (fabs(t - reference[r]) > 1e-6 * fmax(1.0, reference[r]))
+                mismatches ++;
+        }
+        auto end = chrono::steady_clock::now();
+        const double seconds = chrono::duration<double>(end - start).count();
+
+        cout << "  " << KernelName(isa) << ": " << num_rays / seconds * 1e-6 
+             << " Mrays/s, " << mismatches << " mismatches" << endl;
+    }
+}
+
+/******************************************************************
+* Benchmark: Renders a small frame with one ray through each pixel
+* center and reports the time and the number of heap allocations
+* per path. Shading itself does not allocate, so the count is zero.
+* Allocations are only counted in the benchmark build (make bench),
+* which replaces the global operator new.
+* Afterwards the intersection kernels are benchmarked.
+* Run with: ./PathTracing bench (or ./PathTracing-bench bench)
+*******************************************************************/
+
+int benchmark() {
+    const int width = 256;
+    const int height = 192;
+    const int samples = 4;
+
+    Ray camera(Vector(50.0, 52.0, 295.6), Vector(0.0, -0.042612, -1.0).Normalized());
+    Vector cx = Vector(width * 0.5135 / height);
+    Vector cy = (cx.Cross(camera.dir)).Normalized() * 0.5135;
+
+    Color sum;
+#ifdef COUNT_ALLOCATIONS
+    const size_t allocations_before = allocationCount();
+#endif
+    auto start = chrono::steady_clock::now();
+
+    for (int y = 0; y < height; y ++) {
+        for (int x = 0; x < width; x ++) {
+            RNG rng(uint64_t(y) * width + x);
+            Vector dir = cx * ((x + 0.5) / width - 0.5) +
+                         cy * ((y + 0.5) / height - 0.5) + camera.dir;
+            Vector start_pos = camera.org + dir * 130.0;
+            dir = dir.Normalized();
+
+            for (int s = 0; s < samples; s ++)
+                sum = sum + Radiance(Ray(start_pos, dir), false, rng);
+        }
+    }
+
+    auto end = chrono::steady_clock::now();
+#ifdef COUNT_ALLOCATIONS
+    const size_t allocations = allocationCount() - allocations_before;
+#endif
+    const double seconds = chrono::duration<double>(end - start).count();
+    const double paths = double(width) * height * samples;
+
+    cout << "Paths traced:              " << paths << endl;
+    cout << "Time per path:             " << seconds / paths * 1e6 << " us" << endl;
+#ifdef COUNT_ALLOCATIONS
+    cout << "Heap allocations:          " << allocations << endl;
+    cout << "Heap allocations per path: " << allocations / paths << endl;
+#else
+    cout << "Heap allocations:          not counted (build with make bench)" << endl;
+#endif
+    cout << "(Checksum " << sum.x + sum.y + sum.z << ")" << endl;
+
+    benchmarkKernels();
+
+    return 0;
 }
 
+/******************************************************************
+* Unclamped radiance sum of one sample in each of the 2x2 subpixels
+* of a pixel (tent filter). All random numbers of the pixel are
+* drawn from rng, which the caller seeds per pixel and pass.
+*******************************************************************/
+
+#define PIXEL_SAMPLES 4
+
+Color renderPixel(int x, int y, int width, int height, const Ray &camera,
+                  const Vector &cx, const Vector &cy, bool thinLense, RNG &rng) {
+    Color pixel;
+
+    /* 2x2 subsampling per pixel */
+    for (int sy = 0; sy < 2; sy ++) 
+    {
+        for (int sx = 0; sx < 2; sx ++) 
+        {
+            const double r1 = 2.0 * rng.Next();
+            const double r2 = 2.0 * rng.Next();
+
+            /* Transform uniform into non-uniform filter samples */
+            double dx;
+            if (r1 < 1.0)
+                dx = sqrt(r1) - 1.0;
+            else
+                dx = 1.0 - sqrt(2.0 - r1);
+
+            double dy;
+            if (r2 < 1.0)
+                dy = sqrt(r2) - 1.0;
+            else
+                dy = 1.0 - sqrt(2.0 - r2);
+
+            /* Ray direction into scene from camera through sample */
+            Vector dir = cx * ((x + (sx + 0.5 + dx) / 2.0) / width - 0.5) +
+                         cy * ((y + (sy + 0.5 + dy) / 2.0) / height - 0.5) + 
+                         camera.dir;
+            
+            /* Extend camera ray to start inside box */
+            Vector start = camera.org + dir * 130.0;
+
+            dir = dir.Normalized();
+
+            pixel = pixel + Radiance(Ray(start, dir), thinLense, rng);
+        }
+    }
+    return pixel;
+}
 
 /******************************************************************
 * Main routine: Computation of path tracing image (2x2 subpixels).
 * Key parameters:
 * - Image dimensions: width, height 
-* - Number of samples per subpixel (non-uniform filtering): samples 
-* Rendered result saved as PPM image file.
+* - Number of passes, each with one sample per subpixel (non-uniform
+*   filtering): samples 
+* - Number of render threads: -threads n (default: OpenMP maximum)
+* - Edge length of the square render tiles: -tilesize n (default 16)
+* - File for per-tile render times of the last pass: -tilelog file
+* - Maximum number of bounces: -maxdepth n (default 64)
+* - Bounces before Russian Roulette starts: -rrdepth n (default 5)
+* - Output file: -output file (default image.ppm; .pfm for linear floats)
+* - Bits per channel of PPM output: -bits 8|16 (default 8)
+* - Checkpoint file: -checkpoint file (default none; render.ckpt with
+*   -resume)
+* - Minimum time between checkpoints: -interval seconds (default 600)
+* - Continue from the checkpoint file: -resume
+* - Adaptive sampling: -adaptive, with -threshold e (relative error,
+*   default 0.02), -minpasses n (default 2) and -samplemap file (image
+*   of the samples per pixel)
+* The image is rendered in passes over all pixels, each tile by tile
+* by a work-stealing scheduler. The unclamped radiance of all passes
+* is accumulated per pixel. After a pass, the accumulation buffer is
+* saved to the checkpoint file if the interval has elapsed (and always
+* after the last pass), so an interrupted render can be resumed.
+* With adaptive sampling, all pixels are rendered in the first passes
+* only, which take WARMUP_FRACTION of the budget but at least minpasses
+* (two estimates per pixel are needed for an error). Afterwards a pass
+* renders only pixels whose relative error is above the threshold, the
+* noisiest first, until the budget of the uniform render (samples
+* passes over all pixels) is used up, no pixel is above the threshold,
+* or 4 * samples passes are done.
+* Rendered result saved as binary PPM or PFM image file.
 *******************************************************************/
 
+#define WARMUP_FRACTION 0.25
+
 int main(int argc, char *argv[]) {
 	
 	for(Triangle t : box) {tris.push_back(t);}
+	if (!CheckMaterials())
+		return 1;
+	
+	/* Build render arrays and acceleration structure once the scene is complete */
+	for(const Triangle &t : tris) {tri_arrays.Add(t);}
+	bvh.Build(spheres, tris);
+	
+	if (argc == 2 && string(argv[1]) == "bench")
+		return benchmark();
 	
     int width = 1024;
     int height = 768;
     int samples = 1;
     bool thinLense = false;
-
-    if(argc == 2)
-        samples = atoi(argv[1]);  
-	else if(argc == 3) {
-		samples = atoi(argv[1]); 
-		thinLense = argv[2][0] == 't' ? true : false;
-	}
+    int threads = omp_get_max_threads();
+    int tile_size = 16;
+    string tile_log;
+    string output = "image.ppm";
+    int bits = 8;
+    string checkpoint;
+    double interval = 600.0;
+    bool resume = false;
+    bool adaptive = false;
+    double threshold = 0.02;
+    int min_passes = 2;
+    string sample_map;
+
+    /* Positional arguments: samples [thin]; options may appear anywhere */
+    int positional = 0;
+    for (int i = 1; i < argc; i ++) {
+        string arg = argv[i];
+        if (arg == "-threads" && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (arg == "-tilesize" && i + 1 < argc)
+            tile_size = max(1, atoi(argv[++i]));
+        else if (arg == "-tilelog" && i + 1 < argc)
+            tile_log = argv[++i];
+        else if (arg == "-output" && i + 1 < argc)
+            output = argv[++i];
+        else if (arg == "-bits" && i + 1 < argc)
+            bits = atoi(argv[++i]) == 16 ? 16 : 8;
+        else if (arg == "-checkpoint" && i + 1 < argc)
+            checkpoint = argv[++i];
+        else if (arg == "-interval" && i + 1 < argc)
+            interval = atof(argv[++i]);
+        else if (arg == "-resume")
+            resume = true;
+        else if (arg == "-adaptive")
+            adaptive = true;
+        else if (arg == "-threshold" && i + 1 < argc)
+            threshold = atof(argv[++i]);
+        else if (arg == "-minpasses" && i + 1 < argc)
+            min_passes = max(2, atoi(argv[++i]));
+        else if (arg == "-samplemap" && i + 1 < argc)
+            sample_map = argv[++i];
+        else if (arg == "-maxdepth" && i + 1 < argc)
+            max_depth = max(1, atoi(argv[++i]));
+        else if (arg == "-rrdepth" && i + 1 < argc)
+            rr_depth = max(0, atoi(argv[++i]));
+        else if (positional++ == 0)
+            samples = atoi(argv[i]);
+        else
+            thinLense = argv[i][0] == 't' ? true : false;
+    }
         
     /* Set camera origin and viewing direction (negative z direction) */
     Ray camera(Vector(50.0, 52.0, 295.6), Vector(0.0, -0.042612, -1.0).Normalized());
@@ -394,70 +773,92 @@ int main(int argc, char *argv[]) {
     Vector cx = Vector(width * 0.5135 / height);
     Vector cy = (cx.Cross(camera.dir)).Normalized() * 0.5135;
 
-    /* Final rendering */
-    Image img(width, height);
-
-    /* Loop over image rows */
-    for (int y = 0; y < height; y ++) {
-		 
-        cout << "\rRendering (" << samples * 4 << " spp) " << (100.0 * y / (height - 1)) << "%     ";
-        srand(y * y * y);
- 
-        /* Loop over row pixels */
-        #pragma omp parallel for
-        for (int x = 0; x < width; x ++)  
-        {
-            img.setColor(x, y, Color());
- 
-            /* 2x2 subsampling per pixel */
-            for (int sy = 0; sy < 2; sy ++) 
-            {
-                for (int sx = 0; sx < 2; sx ++) 
-                {
-                    Color accumulated_radiance = Color();
-
-                    /* Compute radiance at subpixel using multiple samples */
-                    for (int s = 0; s < samples; s ++) 
-                    {
-                        const double r1 = 2.0 * drand48();
-                        const double r2 = 2.0 * drand48();
-
-                        /* Transform uniform into non-uniform filter samples */
-                        double dx;
-                        if (r1 < 1.0)
-                            dx = sqrt(r1) - 1.0;
-                        else
-                            dx = 1.0 - sqrt(2.0 - r1);
-
-                        double dy;
-                        if (r2 < 1.0)
-                            dy = sqrt(r2) - 1.0;
-                        else
-                            dy = 1.0 - sqrt(2.0 - r2);
-        
-                        /* Ray direction into scene from camera through sample */
-                        Vector dir = cx * ((x + (sx + 0.5 + dx) / 2.0) / width - 0.5) +
-                                     cy * ((y + (sy + 0.5 + dy) / 2.0) / height - 0.5) + 
-                                     camera.dir;
-                        
-                        /* Extend camera ray to start inside box */
-                        Vector start = camera.org + dir * 130.0;
-
-                        dir = dir.Normalized();
+    /* Accumulated radiance of all passes */
+    Accumulator accumulator(width, height);
+    if (resume) {
+        if (checkpoint.empty())
+            checkpoint = "render.ckpt";
+        if (!accumulator.LoadCheckpoint(checkpoint))
+            return 1;
+        cout << "Resuming after pass " << accumulator.passes << " of " << checkpoint << endl;
+    }
 
-                        /* Accumulate radiance */
-                        accumulated_radiance = accumulated_radiance + 
-                            Radiance( Ray(start, dir), 0, 1, thinLense) / samples;
-                    } 
-                    
-                    accumulated_radiance = accumulated_radiance.clamp() * 0.25;
+    /* Uniform passes before adaptive sampling; if they use up the whole
+       budget, no samples are left to distribute */
+    const int warmup_passes = max(min_passes, int(ceil(WARMUP_FRACTION * samples)));
+    if (adaptive && warmup_passes >= samples) {
+        cerr << "Warning: -adaptive has no effect with " << samples << " samples, the "
+             << warmup_passes << " uniform warm-up passes use the whole budget" << endl;
+        adaptive = false;
+    }
 
-                    img.addColor(x, y, accumulated_radiance);
+    cout << "Rendering (" << samples * PIXEL_SAMPLES << " spp) with " << threads << " threads" << endl;
+    
+    TileScheduler scheduler(width, height, tile_size);
+    double last_checkpoint = omp_get_wtime();
+    int checkpoint_passes = accumulator.passes;
+    
+    /* Pixels rendered in the current pass */
+    vector<unsigned char> active(size_t(width) * height, 1);
+    const uint64_t budget = uint64_t(samples) * PIXEL_SAMPLES * width * height;
+    const int max_passes = adaptive ? 4 * samples : samples;
+    
+    for (int pass = accumulator.passes; pass < max_passes; pass ++) {
+        if (adaptive && pass >= warmup_passes) {
+            const uint64_t used = accumulator.TotalSamples();
+            const size_t remaining = used < budget ? (budget - used) / PIXEL_SAMPLES : 0;
+            const size_t num_active = accumulator.SelectNoisy(threshold, remaining, active);
+            if (num_active == 0)
+                break;
+            cout << "Pass " << pass + 1 << ": " << num_active << " pixels above threshold" << endl;
+        } else {
+            cout << "Pass " << pass + 1 << "/" << samples << endl;
+        }
+        
+        scheduler.Run(threads, [&](const Tile &tile) {
+            for (int y = tile.y0; y < tile.y1; y ++) {
+                for (int x = tile.x0; x < tile.x1; x ++) {
+                    if (!active[size_t(y) * width + x])
+                        continue;
+                    /* Seeded by pixel and pass, so the image does not depend on 
+                       the threads or on interruptions */
+                    RNG rng(uint64_t(y) * width + x, pass);
+                    accumulator.Add(x, y, renderPixel(x, y, width, height, camera, cx, cy, 
+                                                      thinLense, rng), PIXEL_SAMPLES);
                 }
             }
+        });
+        accumulator.passes = pass + 1;
+        
+        if (!checkpoint.empty() && omp_get_wtime() - last_checkpoint >= interval) {
+            if (accumulator.SaveCheckpoint(checkpoint))
+                cout << "Checkpoint after pass " << accumulator.passes << " saved to " 
+                     << checkpoint << endl;
+            last_checkpoint = omp_get_wtime();
+            checkpoint_passes = accumulator.passes;
         }
     }
-    cout << endl;
+    
+    if (!checkpoint.empty() && checkpoint_passes != accumulator.passes &&
+        accumulator.SaveCheckpoint(checkpoint))
+        cout << "Checkpoint after pass " << accumulator.passes << " saved to " << checkpoint << endl;
+    
+    scheduler.PrintTimings();
+    if (!tile_log.empty())
+        scheduler.SaveTimings(tile_log);
 
-    img.Save(string("image.ppm"));
+    const uint64_t total = accumulator.TotalSamples();
+    cout << "Samples: " << total << " (" << double(total) / (width * height) 
+         << " spp, " << 100.0 * total / budget << "% of budget)" << endl;
+
+    /* Final rendering */
+    Image img(width, height);
+    accumulator.Resolve(img);
+    
+    if (!sample_map.empty()) {
+        Image map(width, height);
+        accumulator.SampleMap(map);
+        map.Save(sample_map);
+    }
+    return img.Save(output, bits) ? 0 : 1;
 }
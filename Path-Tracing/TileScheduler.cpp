@@ -0,0 +1,173 @@
+#include "TileScheduler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <omp.h>
+
+/*------------------------------------------------------------------
+| Tiles are ordered along a Morton curve, so that consecutive tiles
+| (and thus the tiles of one thread) are close in the image.
+------------------------------------------------------------------*/
+
+static unsigned int MortonCode(unsigned int x, unsigned int y) {
+	unsigned int code = 0;
+	for (int bit = 0; bit < 16; bit++) {
+		code |= ((x >> bit) & 1u) << (2 * bit);
+		code |= ((y >> bit) & 1u) << (2 * bit + 1);
+	}
+	return code;
+}
+
+TileScheduler::TileScheduler(int width, int height, int tile_size) {
+	const int tiles_x = (width + tile_size - 1) / tile_size;
+	const int tiles_y = (height + tile_size - 1) / tile_size;
+	
+	vector<pair<unsigned int, Tile>> ordered;
+	for (int ty = 0; ty < tiles_y; ty++) {
+		for (int tx = 0; tx < tiles_x; tx++) {
+			Tile tile;
+			tile.x0 = tx * tile_size;
+			tile.y0 = ty * tile_size;
+			tile.x1 = min(width, tile.x0 + tile_size);
+			tile.y1 = min(height, tile.y0 + tile_size);
+			tile.seconds = 0.0;
+			tile.thread = -1;
+			ordered.push_back(make_pair(MortonCode(tx, ty), tile));
+		}
+	}
+	
+	sort(ordered.begin(), ordered.end(), 
+		[](const pair<unsigned int, Tile> &a, const pair<unsigned int, Tile> &b) {
+			return a.first < b.first; 
+		});
+	
+	for (const pair<unsigned int, Tile> &t : ordered)
+		tiles.push_back(t.second);
+}
+
+/* Take the next tile from the front of the own range */
+bool TileScheduler::Pop(WorkQueue &queue, size_t &tile) {
+	lock_guard<mutex> guard(queue.lock);
+	if (queue.begin >= queue.end)
+		return false;
+	tile = queue.begin++;
+	return true;
+}
+
+/* Move the back half of the largest remaining range to the thief */
+bool TileScheduler::Steal(vector<WorkQueue> &queues, int thief) {
+	while (true) {
+		int victim = -1;
+		size_t most = 0;
+		for (size_t i = 0; i < queues.size(); i++) {
+			lock_guard<mutex> guard(queues[i].lock);
+			size_t left = queues[i].end > queues[i].begin ? 
+				queues[i].end - queues[i].begin : 0;
+			if ((int)i != thief && left > most) {
+				most = left;
+				victim = i;
+			}
+		}
+		if (victim < 0)
+			return false;
+		
+		size_t begin, end;
+		{
+			lock_guard<mutex> guard(queues[victim].lock);
+			size_t left = queues[victim].end > queues[victim].begin ? 
+				queues[victim].end - queues[victim].begin : 0;
+			if (left == 0)
+				continue;	/* Victim finished meanwhile, look again */
+			end = queues[victim].end;
+			begin = end - (left + 1) / 2;
+			queues[victim].end = begin;
+		}
+		
+		lock_guard<mutex> guard(queues[thief].lock);
+		queues[thief].begin = begin;
+		queues[thief].end = end;
+		return true;
+	}
+}
+
+void TileScheduler::Run(int num_threads, const function<void(const Tile &)> &render_tile) {
+	if (num_threads < 1)
+		num_threads = 1;
+	
+	/* Initial partition of the Morton order into contiguous ranges */
+	vector<WorkQueue> queues(num_threads);
+	for (int i = 0; i < num_threads; i++) {
+		queues[i].begin = tiles.size() * i / num_threads;
+		queues[i].end = tiles.size() * (i + 1) / num_threads;
+	}
+	
+	atomic<size_t> finished(0);
+	
+	/* Tiles not yet taken by any thread. A failed steal does not mean
+	   all queues are empty: a stolen range is briefly in no queue, and
+	   it may be stolen again before its thief pops from it. So threads
+	   keep stealing until every tile is taken. */
+	atomic<size_t> remaining(tiles.size());
+	
+	#pragma omp parallel num_threads(num_threads)
+	{
+		const int thread = omp_get_thread_num();
+		size_t index;
+		
+		while (remaining > 0) {
+			if (!Pop(queues[thread], index)) {
+				Steal(queues, thread);
+				continue;
+			}
+			remaining--;
+			
+			Tile &tile = tiles[index];
+			double start = omp_get_wtime();
+			render_tile(tile);
+			tile.seconds = omp_get_wtime() - start;
+			tile.thread = thread;
+			
+			size_t done = ++finished;
+			if (thread == 0) {
+				cout << "\rRendering " << (100.0 * done / tiles.size()) << "%     " << flush;
+			}
+		}
+	}
+	cout << "\rRendering 100%     " << endl;
+}
+
+void TileScheduler::PrintTimings() const {
+	if (tiles.empty())
+		return;
+	
+	double total = 0.0;
+	const Tile *slowest = &tiles[0];
+	const Tile *fastest = &tiles[0];
+	for (const Tile &tile : tiles) {
+		total += tile.seconds;
+		if (tile.seconds > slowest->seconds) slowest = &tile;
+		if (tile.seconds < fastest->seconds) fastest = &tile;
+	}
+	
+	cout << "Tiles: " << tiles.size() << ", mean " << 1000.0 * total / tiles.size() 
+	     << " ms, fastest " << 1000.0 * fastest->seconds << " ms at (" 
+	     << fastest->x0 << ", " << fastest->y0 << "), slowest " 
+	     << 1000.0 * slowest->seconds << " ms at (" 
+	     << slowest->x0 << ", " << slowest->y0 << ")" << endl;
+}
+
+/* Write one line per tile: x y width height thread milliseconds */
+void TileScheduler::SaveTimings(const string &filename) const {
+	FILE *f = fopen(filename.c_str(), "w");
+	if (!f) {
+		cerr << "Could not write " << filename << endl;
+		return;
+	}
+	for (const Tile &tile : tiles) {
+		fprintf(f, "%d %d %d %d %d %.3f\n", tile.x0, tile.y0, tile.x1 - tile.x0,
+		        tile.y1 - tile.y0, tile.thread, 1000.0 * tile.seconds);
+	}
+	fclose(f);
+}
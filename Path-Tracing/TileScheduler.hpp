@@ -0,0 +1,42 @@
+#ifndef _TILESCHEDULER_H_
+#define _TILESCHEDULER_H_
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/* Rectangular block of pixels [x0, x1) x [y0, y1) */
+struct Tile {
+	int x0, y0, x1, y1;
+	double seconds;			/* Render time of the tile */
+	int thread;				/* Thread that rendered the tile */
+};
+
+/* Splits the frame into square tiles in Morton (Z-curve) order and
+   renders them in parallel. Every thread owns a contiguous range of
+   tiles and steals half of the remaining range of another thread
+   when its own range is exhausted, until all tiles are taken. */
+struct TileScheduler {
+	vector<Tile> tiles;
+	
+	TileScheduler(int width, int height, int tile_size);
+	
+	void Run(int num_threads, const function<void(const Tile &)> &render_tile);
+	void PrintTimings() const;
+	void SaveTimings(const string &filename) const;
+
+private:
+	/* Range [begin, end) of tile indices owned by one thread */
+	struct WorkQueue {
+		mutex lock;
+		size_t begin, end;
+	};
+	
+	bool Pop(WorkQueue &queue, size_t &tile);
+	bool Steal(vector<WorkQueue> &queues, int thief);
+};
+
+#endif // _TILESCHEDULER_H_
@@ -0,0 +1,286 @@
+#include "FormFactors.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+FormFactorMatrix::FormFactorMatrix() : 
+	size(0), storage(FF_DOUBLE), nonzeros(0), mapping(nullptr), mapping_size(0) {
+	UpdateViews();
+}
+
+FormFactorMatrix::~FormFactorMatrix() {
+	Release();
+}
+
+void FormFactorMatrix::Release() {
+	if (mapping)
+		munmap(mapping, mapping_size);
+	mapping = nullptr;
+	mapping_size = 0;
+	
+	vector<uint64_t>().swap(owned_row_start);
+	vector<int32_t>().swap(owned_columns);
+	vector<double>().swap(owned_values);
+	vector<float>().swap(owned_values_float);
+	vector<uint16_t>().swap(owned_values_quantized);
+	vector<double>().swap(owned_row_scale);
+}
+
+void FormFactorMatrix::UpdateViews() {
+	row_start = owned_row_start.data();
+	columns = owned_columns.data();
+	values = owned_values.data();
+	values_float = owned_values_float.data();
+	values_quantized = owned_values_quantized.data();
+	row_scale = owned_row_scale.data();
+}
+
+void FormFactorMatrix::Build(vector<vector<FormFactorEntry>> &upper, 
+                             const vector<double> &area, FormFactorStorage storage_) {
+	Release();
+	size = upper.size();
+	storage = storage_;
+	
+	/* Entry (i, j) of the upper triangle also gives entry (j, i) */
+	vector<size_t> row_size(size, 0);
+	for (int i = 0; i < size; i++) {
+		row_size[i] += upper[i].size();
+		for (const FormFactorEntry &e : upper[i])
+			row_size[e.column]++;
+	}
+	
+	owned_row_start.assign(size + 1, 0);
+	for (int i = 0; i < size; i++)
+		owned_row_start[i + 1] = owned_row_start[i] + row_size[i];
+	
+	nonzeros = owned_row_start[size];
+	owned_columns.assign(nonzeros, 0);
+	owned_values.assign(nonzeros, 0.0);
+	
+	/* Rows are filled in order of i; entries (j, i) from the upper
+	   triangle of earlier rows arrive first, so columns stay sorted */
+	vector<size_t> cursor(owned_row_start.begin(), owned_row_start.end() - 1);
+	for (int i = 0; i < size; i++) {
+		for (const FormFactorEntry &e : upper[i]) {
+			size_t k = cursor[i]++;
+			owned_columns[k] = e.column;
+			owned_values[k] = min(e.value / area[i], 1.0);
+			
+			k = cursor[e.column]++;
+			owned_columns[k] = i;
+			owned_values[k] = min(e.value / area[e.column], 1.0);
+		}
+		vector<FormFactorEntry>().swap(upper[i]);
+	}
+	
+	if (storage == FF_FLOAT) {
+		owned_values_float.assign(owned_values.begin(), owned_values.end());
+		vector<double>().swap(owned_values);
+	} else if (storage == FF_QUANTIZED) {
+		owned_values_quantized.assign(nonzeros, 0);
+		owned_row_scale.assign(size, 0.0);
+		for (int i = 0; i < size; i++) {
+			const uint64_t begin = owned_row_start[i];
+			const uint64_t end = owned_row_start[i + 1];
+			double row_max = 0.0;
+			for (uint64_t k = begin; k < end; k++)
+				row_max = max(row_max, owned_values[k]);
+			owned_row_scale[i] = row_max / 65535.0;
+			for (uint64_t k = begin; k < end; k++)
+				owned_values_quantized[k] = uint16_t(owned_values[k] / row_max * 65535.0 + 0.5);
+		}
+		vector<double>().swap(owned_values);
+	}
+	UpdateViews();
+}
+
+/*------------------------------------------------------------------
+| Cache file: header, followed by row starts, columns, values (in
+| the stored precision) and, if quantized, the row scales; every
+| array starts at a multiple of 8 bytes, so it can be used directly
+| from the mapped file.
+------------------------------------------------------------------*/
+
+static const char CACHE_MAGIC[8] = { 'R', 'A', 'D', 'F', 'F', 'C', '0', '1' };
+
+struct CacheHeader {
+	char magic[8];
+	uint64_t key;
+	int32_t size, storage;
+	uint64_t nonzeros;
+};
+
+static size_t Align8(size_t bytes) {
+	return (bytes + 7) & ~size_t(7);
+}
+
+static size_t ValueBytes(FormFactorStorage storage) {
+	return storage == FF_DOUBLE ? sizeof(double) : 
+	       storage == FF_FLOAT ? sizeof(float) : sizeof(uint16_t);
+}
+
+bool FormFactorMatrix::Save(const string &filename, uint64_t key) const {
+	CacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+	header.key = key;
+	header.size = size;
+	header.storage = storage;
+	header.nonzeros = nonzeros;
+	
+	const void *value_data = storage == FF_DOUBLE ? (const void *)values :
+	                         storage == FF_FLOAT ? (const void *)values_float : 
+	                                               (const void *)values_quantized;
+	const struct { const void *data; size_t bytes; } sections[] = {
+		{ &header, sizeof(header) },
+		{ row_start, (size + 1) * sizeof(uint64_t) },
+		{ columns, nonzeros * sizeof(int32_t) },
+		{ value_data, nonzeros * ValueBytes(storage) },
+		{ row_scale, storage == FF_QUANTIZED ? size * sizeof(double) : 0 },
+	};
+	
+	const string temp = filename + ".tmp";
+	FILE *f = fopen(temp.c_str(), "wb");
+	if (!f) {
+		cerr << "Could not write form factor cache " << temp << endl;
+		return false;
+	}
+	const char padding[8] = { 0 };
+	bool ok = true;
+	for (const auto &section : sections) {
+		ok = ok && fwrite(section.data, 1, section.bytes, f) == section.bytes;
+		const size_t pad = Align8(section.bytes) - section.bytes;
+		ok = ok && fwrite(padding, 1, pad, f) == pad;
+	}
+	ok = fclose(f) == 0 && ok;
+	
+	if (!ok || rename(temp.c_str(), filename.c_str()) != 0) {
+		cerr << "Could not write form factor cache " << filename << endl;
+		remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool FormFactorMatrix::Load(const string &filename, uint64_t key, int size_, 
+                            FormFactorStorage storage_) {
+	const int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	
+	struct stat st;
+	if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(CacheHeader)) {
+		close(fd);
+		return false;
+	}
+	void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+	
+	const char *data = (const char *)map;
+	const CacheHeader *header = (const CacheHeader *)data;
+	const size_t value_bytes = header->nonzeros * ValueBytes(storage_);
+	const size_t expected = Align8(sizeof(CacheHeader)) + 
+	                        Align8((size_t(size_) + 1) * sizeof(uint64_t)) + 
+	                        Align8(header->nonzeros * sizeof(int32_t)) + Align8(value_bytes) + 
+	                        (storage_ == FF_QUANTIZED ? size_ * sizeof(double) : 0);
+	
+	if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0 || 
+	    header->key != key || header->size != size_ || header->storage != storage_ ||
+	    size_t(st.st_size) != expected) {
+		munmap(map, st.st_size);
+		return false;
+	}
+	
+	Release();
+	mapping = map;
+	mapping_size = st.st_size;
+	size = size_;
+	storage = storage_;
+	nonzeros = header->nonzeros;
+	UpdateViews();
+	
+	size_t offset = Align8(sizeof(CacheHeader));
+	row_start = (const uint64_t *)(data + offset);
+	offset += Align8((size_t(size) + 1) * sizeof(uint64_t));
+	columns = (const int32_t *)(data + offset);
+	offset += Align8(nonzeros * sizeof(int32_t));
+	if (storage == FF_DOUBLE)
+		values = (const double *)(data + offset);
+	else if (storage == FF_FLOAT)
+		values_float = (const float *)(data + offset);
+	else
+		values_quantized = (const uint16_t *)(data + offset);
+	offset += Align8(value_bytes);
+	if (storage == FF_QUANTIZED)
+		row_scale = (const double *)(data + offset);
+	
+	return true;
+}
+
+template<typename T>
+static Color GatherRow(const T *values, double scale, const int32_t *columns, 
+                       uint64_t begin, uint64_t end, const vector<const Color *> &radiosity) {
+	Color B;
+	for (uint64_t k = begin; k < end; k++)
+		B = B + (values[k] * scale) * *radiosity[columns[k]];
+	return B;
+}
+
+Color FormFactorMatrix::Gather(int i, const vector<const Color *> &radiosity) const {
+	const uint64_t begin = row_start[i];
+	const uint64_t end = row_start[i + 1];
+	switch (storage) {
+		case FF_FLOAT: 
+			return GatherRow(values_float, 1.0, columns, begin, end, radiosity);
+		case FF_QUANTIZED: 
+			return GatherRow(values_quantized, row_scale[i], columns, begin, end, radiosity);
+		default: 
+			return GatherRow(values, 1.0, columns, begin, end, radiosity);
+	}
+}
+
+size_t FormFactorMatrix::NonZeros() const {
+	return nonzeros;
+}
+
+size_t FormFactorMatrix::Bytes() const {
+	return (size + 1) * sizeof(uint64_t) + nonzeros * (sizeof(int32_t) + ValueBytes(storage)) +
+	       (storage == FF_QUANTIZED ? size * sizeof(double) : 0);
+}
+
+uint64_t HashBytes(const void *data, size_t bytes, uint64_t hash) {
+	const unsigned char *p = (const unsigned char *)data;
+	for (size_t i = 0; i < bytes; i++) {
+		hash ^= p[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+bool ParseStorage(const string &name, FormFactorStorage &storage) {
+	if (name == "double") 
+		storage = FF_DOUBLE;
+	else if (name == "float") 
+		storage = FF_FLOAT;
+	else if (name == "quantized") 
+		storage = FF_QUANTIZED;
+	else 
+		return false;
+	return true;
+}
+
+const char *StorageName(FormFactorStorage storage) {
+	switch (storage) {
+		case FF_DOUBLE: return "double";
+		case FF_FLOAT: return "float";
+		case FF_QUANTIZED: return "quantized";
+	}
+	return "unknown";
+}
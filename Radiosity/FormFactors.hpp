@@ -0,0 +1,86 @@
+#ifndef _FORMFACTORS_H_
+#define _FORMFACTORS_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Structs.hpp"
+
+using namespace std;
+
+/* Precision of the stored form factors */
+enum FormFactorStorage { FF_DOUBLE, FF_FLOAT, FF_QUANTIZED };
+
+/* Nonzero form factor of a row while the matrix is built */
+struct FormFactorEntry {
+	int column;
+	double value;
+};
+
+/* Sparse form factor matrix in compressed sparse row (CSR) layout:
+   the nonzero F_ij of row i are stored at positions 
+   row_start[i] .. row_start[i+1]-1, with ascending columns j. Values
+   are kept as double, float or as 16 bit integers scaled by the
+   maximum of their row (FF_QUANTIZED).
+   The arrays are either owned by the matrix (after Build) or mapped
+   read-only from a cache file (after Load). */
+struct FormFactorMatrix {
+	int size;
+	FormFactorStorage storage;
+	size_t nonzeros;
+	
+	/* Views of the arrays */
+	const uint64_t *row_start;
+	const int32_t *columns;
+	const double *values;				/* FF_DOUBLE */
+	const float *values_float;			/* FF_FLOAT */
+	const uint16_t *values_quantized;	/* FF_QUANTIZED */
+	const double *row_scale;			/* FF_QUANTIZED: F = value * row_scale */
+	
+	FormFactorMatrix();
+	~FormFactorMatrix();
+	FormFactorMatrix(const FormFactorMatrix &) = delete;
+	FormFactorMatrix &operator=(const FormFactorMatrix &) = delete;
+	
+	/* Builds the symmetric matrix from the upper triangle: upper[i]
+	   holds the nonzero area weighted estimates (A_i * F_ij) for
+	   j > i in ascending order; rows are divided by the patch area
+	   and clamped to 1. The entries are released while building. */
+	void Build(vector<vector<FormFactorEntry>> &upper, const vector<double> &area,
+	           FormFactorStorage storage_);
+	
+	/* Cache file with the given key; Load() maps the file and fails
+	   if it is missing or was written for another key or size */
+	bool Save(const string &filename, uint64_t key) const;
+	bool Load(const string &filename, uint64_t key, int size_, FormFactorStorage storage_);
+	
+	/* Sum of F_ij * radiosity[j] over the nonzeros of row i */
+	Color Gather(int i, const vector<const Color *> &radiosity) const;
+	
+	size_t NonZeros() const;
+	size_t Bytes() const;
+
+private:
+	vector<uint64_t> owned_row_start;
+	vector<int32_t> owned_columns;
+	vector<double> owned_values;
+	vector<float> owned_values_float;
+	vector<uint16_t> owned_values_quantized;
+	vector<double> owned_row_scale;
+	
+	void *mapping;
+	size_t mapping_size;
+	
+	void Release();
+	void UpdateViews();
+};
+
+/* 64 bit FNV-1a hash of a block of memory, continued from hash */
+uint64_t HashBytes(const void *data, size_t bytes, 
+                   uint64_t hash = 14695981039346656037ULL);
+
+bool ParseStorage(const string &name, FormFactorStorage &storage);
+const char *StorageName(FormFactorStorage storage);
+
+#endif // _FORMFACTORS_H_
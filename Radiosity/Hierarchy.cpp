@@ -0,0 +1,219 @@
+#include "Hierarchy.hpp"
+
+#include <algorithm>
+
+/* Power measure of a radiosity, mean over the color channels */
+static double Power(const Color &c) {
+	return (c.x + c.y + c.z) / 3.0;
+}
+
+HNode::HNode(const Triangle &tri_, int tri_id_, int level_, int index_) :
+	tri(tri_), tri_id(tri_id_), level(level_), index(index_), first_child(-1),
+	B(tri_.emission) {
+}
+
+HierarchicalRadiosity::HierarchicalRadiosity(const vector<Triangle> &tris, int max_level_,
+                                             const Estimator &estimate_) :
+	roots(tris.size()), max_level(max_level_), estimate(estimate_), estimates(0) {
+	
+	for (int i = 0; i < roots; i++)
+		nodes.push_back(HNode(tris[i], i, 0, 0));
+}
+
+bool HierarchicalRadiosity::Subdivide(int p) {
+	if (nodes[p].first_child >= 0)
+		return true;
+	if (nodes[p].level >= max_level)
+		return false;
+	
+	Triangle t[4] = { nodes[p].tri, nodes[p].tri, nodes[p].tri, nodes[p].tri };
+	nodes[p].tri.subdivide(t);
+	
+	/* Children start with the radiosity of the parent */
+	const int first = nodes.size();
+	const int tri_id = nodes[p].tri_id, level = nodes[p].level, index = nodes[p].index;
+	const Color B = nodes[p].B;
+	for (int k = 0; k < 4; k++) {
+		nodes.push_back(HNode(t[k], tri_id, level + 1, 4 * index + k));
+		nodes.back().B = B;
+	}
+	nodes[p].first_child = first;
+	return true;
+}
+
+void HierarchicalRadiosity::AddLink(int p, int q) {
+	estimates++;
+	const double AF = estimate(nodes[p], nodes[q]);
+	if (AF > 0.0)
+		nodes[p].links.push_back({ q, min(AF / nodes[p].tri.area, 1.0) });
+}
+
+/* Links receiver p with source q; if one of the form factors between
+   them exceeds ff_epsilon, the node seen under the larger form factor
+   is subdivided instead (the larger node, as A_p F_pq = A_q F_qp) */
+void HierarchicalRadiosity::Refine(int p, int q, double ff_epsilon) {
+	estimates++;
+	const double AF = estimate(nodes[p], nodes[q]);
+	const double F_pq = AF / nodes[p].tri.area;
+	const double F_qp = AF / nodes[q].tri.area;
+	
+	if (max(F_pq, F_qp) > ff_epsilon) {
+		const bool split_q_first = F_pq >= F_qp;
+		if (split_q_first && Subdivide(q)) {
+			for (int k = 0; k < 4; k++)
+				Refine(p, nodes[q].first_child + k, ff_epsilon);
+			return;
+		}
+		if (Subdivide(p)) {
+			for (int k = 0; k < 4; k++)
+				Refine(nodes[p].first_child + k, q, ff_epsilon);
+			return;
+		}
+		if (!split_q_first && Subdivide(q)) {
+			for (int k = 0; k < 4; k++)
+				Refine(p, nodes[q].first_child + k, ff_epsilon);
+			return;
+		}
+	}
+	if (AF > 0.0)
+		nodes[p].links.push_back({ q, min(F_pq, 1.0) });
+}
+
+void HierarchicalRadiosity::Link(double ff_epsilon) {
+	for (int p = 0; p < roots; p++)
+		for (int q = 0; q < roots; q++)
+			if (p != q)
+				Refine(p, q, ff_epsilon);
+}
+
+int HierarchicalRadiosity::RefineBF(double bf_epsilon) {
+	double emitted = 0.0;
+	for (int p = 0; p < roots; p++)
+		emitted += Power(nodes[p].tri.emission) * nodes[p].tri.area;
+	const double threshold = bf_epsilon * emitted;
+	
+	int refined = 0;
+	const int count = nodes.size();
+	for (int p = 0; p < count; p++) {
+		vector<HLink> links;
+		links.swap(nodes[p].links);
+		
+		for (const HLink &link : links) {
+			const int q = link.source;
+			const double power = Power(nodes[p].tri.color.MultComponents(nodes[q].B)) *
+			                     link.F * nodes[p].tri.area;
+			if (power > threshold) {
+				/* Split the larger node, the smaller one if the larger is a leaf */
+				const bool split_q_first = nodes[q].tri.area >= nodes[p].tri.area;
+				if (split_q_first && Subdivide(q)) {
+					for (int k = 0; k < 4; k++)
+						AddLink(p, nodes[q].first_child + k);
+					refined++;
+					continue;
+				}
+				if (Subdivide(p)) {
+					for (int k = 0; k < 4; k++)
+						AddLink(nodes[p].first_child + k, q);
+					refined++;
+					continue;
+				}
+				if (!split_q_first && Subdivide(q)) {
+					for (int k = 0; k < 4; k++)
+						AddLink(p, nodes[q].first_child + k);
+					refined++;
+					continue;
+				}
+			}
+			nodes[p].links.push_back(link);
+		}
+	}
+	return refined;
+}
+
+/* Pushes the gathered radiosity down to the leaves, where emission
+   is added, and pulls the area average up; children have equal area */
+Color HierarchicalRadiosity::PushPull(int p, const Color &down) {
+	const Color received = down + nodes[p].gathered;
+	Color B;
+	if (nodes[p].first_child < 0) {
+		B = nodes[p].tri.emission + received;
+	} else {
+		for (int k = 0; k < 4; k++)
+			B = B + PushPull(nodes[p].first_child + k, received) * 0.25;
+	}
+	nodes[p].B = B;
+	return B;
+}
+
+int HierarchicalRadiosity::Solve(double tolerance, int max_iterations) {
+	const int count = nodes.size();
+	int iteration = 0;
+	while (iteration < max_iterations) {
+		iteration++;
+		
+		/* Gathering only reads B, so the nodes are independent */
+		#pragma omp parallel for schedule(dynamic, 256)
+		for (int p = 0; p < count; p++) {
+			Color G;
+			for (const HLink &link : nodes[p].links)
+				G = G + link.F * nodes[link.source].B;
+			nodes[p].gathered = nodes[p].tri.color.MultComponents(G);
+		}
+		
+		double change = 0.0, total = 0.0;
+		for (int p = 0; p < roots; p++) {
+			const Color old = nodes[p].B;
+			const Color B = PushPull(p, Color());
+			change += fabs(Power(B) - Power(old)) * nodes[p].tri.area;
+			total += Power(B) * nodes[p].tri.area;
+		}
+		if (change <= tolerance * total)
+			break;
+	}
+	return iteration;
+}
+
+void HierarchicalRadiosity::FillLeaves(int p, vector<Color> &patch) const {
+	const HNode &node = nodes[p];
+	if (node.first_child >= 0) {
+		for (int k = 0; k < 4; k++)
+			FillLeaves(node.first_child + k, patch);
+		return;
+	}
+	/* Uniform patches below a leaf on level d: 4^(max_level - d) of them */
+	const size_t span = size_t(1) << (2 * (max_level - node.level));
+	fill(patch.begin() + node.index * span, patch.begin() + (node.index + 1) * span, node.B);
+}
+
+void HierarchicalRadiosity::Leaves(int tri_id, vector<Color> &patch) const {
+	patch.assign(size_t(1) << (2 * max_level), Color());
+	FillLeaves(tri_id, patch);
+}
+
+size_t HierarchicalRadiosity::Links() const {
+	size_t links = 0;
+	for (const HNode &node : nodes)
+		links += node.links.size();
+	return links;
+}
+
+size_t HierarchicalRadiosity::LeafCount() const {
+	size_t leaves = 0;
+	for (const HNode &node : nodes)
+		leaves += node.first_child < 0;
+	return leaves;
+}
+
+bool ParseOracle(const string &name, RefinementOracle &oracle) {
+	if (name == "ff") 
+		oracle = ORACLE_FF;
+	else if (name == "bf") 
+		oracle = ORACLE_BF;
+	else 
+		return false;
+	return true;
+}
+
+const char *OracleName(RefinementOracle oracle) {
+	return oracle == ORACLE_FF ? "ff" : "bf";
+}
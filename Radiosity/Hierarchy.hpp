@@ -0,0 +1,86 @@
+#ifndef _HIERARCHY_H_
+#define _HIERARCHY_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Structs.hpp"
+
+using namespace std;
+
+/* Refinement oracle of the hierarchical solver */
+enum RefinementOracle { ORACLE_FF, ORACLE_BF };
+
+/* Gather link: the receiver gets F * B of node source, F being the
+   form factor from the receiver to the source */
+struct HLink {
+	int source;
+	double F;
+};
+
+/* Node of the quadtree of a scene triangle; level 0 is the whole
+   triangle, the children of node e on level d are nodes 4 * e + k 
+   on level d + 1, numbered like the patches of PatchSet */
+struct HNode {
+	Triangle tri;
+	int tri_id, level, index;
+	int first_child;		/* Index of first of 4 children, -1 for leaves */
+	Color B;				/* Radiosity, area average over the subtree */
+	Color gathered;			/* Radiosity received over the links */
+	vector<HLink> links;
+	
+	HNode(const Triangle &tri_, int tri_id_, int level_, int index_);
+};
+
+/* Hierarchical radiosity (Hanrahan, Salzman, Aupperle 1991): 
+   triangles are subdivided adaptively down to max_level, and energy 
+   is exchanged over links between nodes of any level. Pairs are linked
+   where the form factor estimate is below ff_epsilon; with the BF oracle,
+   links that transport more than bf_epsilon of the emitted power 
+   (rho * B * F * A) are refined between solver passes. */
+struct HierarchicalRadiosity {
+	/* Estimate of A_p * F_pq for two nodes on different triangles; 
+	   must return the same value for (p, q) and (q, p) */
+	typedef function<double(const HNode &p, const HNode &q)> Estimator;
+	
+	vector<HNode> nodes;
+	int roots;
+	int max_level;
+	Estimator estimate;
+	size_t estimates;
+	
+	HierarchicalRadiosity(const vector<Triangle> &tris, int max_level_, 
+	                      const Estimator &estimate_);
+	
+	/* Links all pairs of triangles, refined with the form factor oracle */
+	void Link(double ff_epsilon);
+	
+	/* Refines links transporting more than bf_epsilon of the emitted
+	   power by one level; returns the number of refined links */
+	int RefineBF(double bf_epsilon);
+	
+	/* Jacobi iterations of gathering over the links and push-pull
+	   through the hierarchy, until the radiosity of the triangles 
+	   changes less than tolerance; returns the iterations */
+	int Solve(double tolerance, int max_iterations);
+	
+	/* Radiosity of the 4^max_level uniform patches of a triangle */
+	void Leaves(int tri_id, vector<Color> &patch) const;
+	
+	size_t Links() const;
+	size_t LeafCount() const;
+
+private:
+	bool Subdivide(int p);
+	void Refine(int p, int q, double ff_epsilon);
+	void AddLink(int p, int q);
+	Color PushPull(int p, const Color &down);
+	void FillLeaves(int p, vector<Color> &patch) const;
+};
+
+bool ParseOracle(const string &name, RefinementOracle &oracle);
+const char *OracleName(RefinementOracle oracle);
+
+#endif // _HIERARCHY_H_
@@ -27,17 +27,32 @@
 *******************************************************************/
 
 #include <unistd.h>
+#include <omp.h>
 
 /* Include all structs (Vector, Ray, Triangle, ..). */
 #include "Structs.hpp"
+#include "TriangleKernel.hpp"
+#include "BVH.hpp"
+#include "VertexIndex.hpp"
+#include "Random.hpp"
+#include "Sampling.hpp"
+#include "FormFactors.hpp"
+#include "Hierarchy.hpp"
 
 using namespace std;
 
 const double Over_M_PI = 1.0/M_PI;
 
-static double *form_factor;
+static FormFactorMatrix form_factors;
 static int patch_num = 0;
 
+/* First patch of every triangle and triangle of every patch */
+static vector<int> patch_offset;
+static vector<int> patch_tri;
+
+/* Area of every patch */
+static vector<double> patch_area;
+
 /* Define test function (to be found at the end of the file */
 void test_intersection();
 
@@ -113,47 +128,59 @@ vector<Triangle> Rectangles_To_Triangles() {
 /* Triangle version of recs*/
 vector<Triangle> tris = Rectangles_To_Triangles();
 
+/* Radiosity patches of each triangle, indexed like tris */
+vector<PatchSet> patch_sets(tris.size());
+
+/* Bounding volume hierarchy over the triangles, leaves packed for
+   the SIMD intersection kernel. A packet test is cheap compared to
+   the scalar box tests of a traversal step, so small scenes like the
+   Cornell box stay a single leaf and larger ones get big leaves */
+#define BVH_MAX_LEAF_SIZE 32
+#define BVH_TRAVERSAL_COST 4.0
+
+BVH Build_BVH() {
+	BVH bvh(BVH_MAX_LEAF_SIZE, BVH_TRAVERSAL_COST);
+	bvh.Build(tris);
+	return bvh;
+}
+
+BVH scene_bvh = Build_BVH();
+
 /******************************************************************
 * Check for closest intersection of a ray with the scene;
 * Returns true if intersection is found, as well as ray parameter
-* of intersection and id of intersected object
+* of intersection and id of intersected object;
+* Triangles are found via the BVH and tested a packet at a time 
+* with the SIMD kernel
 *******************************************************************/
 bool Intersect_Scene(const Ray &ray, double *t, int *id, Vector *normal) {
 	
-    const int n = tris.size();
-    *t  = 1e20;
-    *id = -1;
-	
-    for (int i = 0; i < n; i ++)
-    {
-        double d = tris[i].intersect(ray);
-        if (d > 0.0 && d < *t) 
-        {
-            *t  = d;
-            *id = i;
-            *normal = tris[i].normal;
-        }
-    }
-    return *t < 1e20;
+    size_t hit_id;
+    Type type;
+    if (!scene_bvh.Intersect(ray, *t, hit_id, type))
+        return false;
+    
+    *id = int(hit_id);
+    *normal = tris[*id].normal;
+    return true;
 }
 
 /******************************************************************
 * Determine all form factors for all pairs of patches (of all
 * triangles);
 * Evaluation of integrals in form factor equation is done via
-* Monte Carlo integration; samples are uniformly distributed and
-* equally weighted;
+* Monte Carlo integration; sample points are taken from a
+* precomputed table (uniform, stratified or Halton points), 
+* randomized per patch pair, and equally weighted;
 * Computation accelerated by exploiting symmetries of form factor
-* estimation;
+* estimation and by distributing the patch pairs over all threads;
 *******************************************************************/
 
-/* Function to calculate a sample point inside a triangle */
-Vector get_sample_point(Vector v1, Vector v2, Vector v3){
-	srand(time(nullptr));
-	
-	double epsilon1 = drand48();
-	double epsilon2 = drand48();
-	
+/* Function to calculate a sample point inside a triangle from two
+   numbers in [0,1); area preserving, so strata of the unit square
+   map to strata of equal area on the triangle */
+Vector get_sample_point(const Vector &v1, const Vector &v2, const Vector &v3, 
+                        double epsilon1, double epsilon2){
 	double lambda0 = 1.0 - sqrt(epsilon1);
 	double lambda1 = epsilon2 * sqrt(epsilon1);
 	double lambda2 = 1.0 - lambda0 - lambda1;
@@ -163,319 +190,551 @@ Vector get_sample_point(Vector v1, Vector v2, Vector v3){
 	return q;
 }
 
-void Calculate_Form_Factors(const int div_num, 
-                            const int mc_sample) 
+/******************************************************************
+* Subdivision of all triangles into patches and indexing of the 
+* patches in 1D-arrays
+*******************************************************************/
+
+void Init_Patches(const int div_num) 
 {
     /* Total number of patches in scene */
     const int n = tris.size();
     for (int i = 0; i < n; i ++) 
     {
-        tris[i].init_patchs(div_num); 
+        patch_sets[i].init_patchs(tris[i], div_num); 
         patch_num += pow(4, div_num);
     }
     
     std::cout << "Number of triangles: " << n << endl;
     cout << "Number of patches: " << patch_num << endl;
-    int form_factor_num = patch_num * patch_num;
-    cout << "Number of form factors: " << form_factor_num << endl;
-    
-    /* 1D-array to hold form factor pairs */
-    form_factor = new double[form_factor_num];
-    memset(form_factor, 0.0, sizeof(double) * form_factor_num);
 
-    /* 1D-array with patch areas */
-    double *patch_area = new double[patch_num];
-    memset(patch_area, 0.0, sizeof(double) * patch_num);
+    /* Offsets for indexing of patches in 1D-arrays */
+    patch_offset.assign(n, 0);
+    patch_tri.assign(patch_num, 0);
+    for (int i = 0; i < n; i ++) {
+        for (int k = 0; k < i; k ++)
+            patch_offset[i] += patch_sets[k].patches.size();
+        for (unsigned long ip = 0; ip < patch_sets[i].patches.size(); ip ++)
+            patch_tri[patch_offset[i] + ip] = i;
+    }
 
-    /* Precompute patch areas, assuming same size for each triangle */
+    /* Patch areas, assuming same size for each triangle */
+    patch_area.clear();
     for (int i = 0; i < n; i ++) 
-    {
-        int patch_i = 0;
-        for (int k = 0; k < i; k ++)
-            patch_i += pow(4, div_num);
+        for (unsigned long ip = 0; ip < patch_sets[i].patches.size(); ip ++)
+            patch_area.push_back(tris[i].area / patch_sets[i].patches.size());
+}
 
-        for (int ip = 0; ip < pow(4, div_num); ip ++) 
-        {
-				int index = patch_i + ip;
-                patch_area[index] = tris[i].area / tris[i].patches.size(); 
-        
-        }
+/******************************************************************
+* Key of the form factor cache: form factors depend only on the 
+* geometry, the subdivision and the sampling, so emission and 
+* reflectivity of the rectangles are left out; relighting or 
+* recoloring the scene reuses the cached form factors
+*******************************************************************/
+
+uint64_t Form_Factor_Key(const int div_num, const int mc_sample, 
+                         Sampler sampler, FormFactorStorage storage,
+                         bool hemisphere)
+{
+    uint64_t key = HashBytes("RADFF01", 8);
+    for (const Rectangle &rec : recs) {
+        const double geometry[9] = { rec.p0.x, rec.p0.y, rec.p0.z,
+                                     rec.edge_a.x, rec.edge_a.y, rec.edge_a.z,
+                                     rec.edge_b.x, rec.edge_b.y, rec.edge_b.z };
+        key = HashBytes(geometry, sizeof(geometry), key);
     }
-    
+    const int32_t params[5] = { div_num, mc_sample, sampler, storage, hemisphere };
+    return HashBytes(params, sizeof(params), key);
+}
+
+/******************************************************************
+* Monte Carlo estimate of A_i * F_ij for two triangular patches with
+* corners patches_i, patches_j on scene triangles i != j
+*******************************************************************/
+
+double Sample_Form_Factor(const Vector *patches_i, int i, double area_i,
+                          const Vector *patches_j, int j, double area_j,
+                          const SampleTable &samples, RNG &rng)
+{
+    const Vector &normal_i = tris[i].normal;
+    const Vector &normal_j = tris[j].normal;
+
+    /* Intemediate value; will be divided by patch area later */
+    double F = 0;
+                            
+    /* Uniform PDF for Monte Carlo (1/Ai)x(1/Aj) */
+    const double pdf = (1.0 / area_i) * (1.0 / area_j);
+
+    double shift[4];
+    samples.Shift(rng, shift);
+
+    /* Determine rays of NixNi samples of patch on i to NjxNj 
+        samples of patch on j */
+    for (int s = 0; s < samples.count; s ++) {
+                
+        /* Determine sample points xi, xj on both patches */
+        double e[4];
+        samples.Get(s, shift, rng, e);
+        const Vector xi = get_sample_point(patches_i[0], patches_i[1], 
+            patches_i[2], e[0], e[1]);
+        const Vector xj = get_sample_point(patches_j[0], patches_j[1],
+            patches_j[2], e[2], e[3]);
+
+        /* Check for visibility between sample points */
+        const Vector ij = (xj - xi).Normalized();
+
+        double t; 
+        int id;
+        Vector normal; 
+        if (Intersect_Scene(Ray(xi, ij), &t, &id, &normal) && id != j) {
+            continue; /* If intersection with other rectangle */
+        }
+
+        /* Cosines of angles beteen normals and ray inbetween */
+        const double d0 = normal_i.Dot(ij);
+        const double d1 = normal_j.Dot(-1.0 * ij);
+
+        /* Continue if patches facing each other */
+        if (d0 > 0.0 && d1 > 0.0) {
+            /* Sample form factor */
+            const double K = d0 * d1 / (M_PI * (xj - xi).LengthSquared());
+
+            /* Add weighted sample to estimate */
+            F += K / pdf;
+        }
+    } 
+
+    /* Divide by number of samples */
+    return F / samples.count; 
+}
+
+/******************************************************************
+* Estimate of A_i * F_ij for two patches on different triangles;
+* symmetric in i and j, as the pair is always sampled with the random
+* sequence of (lower, higher) patch index
+*******************************************************************/
+
+double Estimate_Form_Factor(int patch_i, int patch_j, const SampleTable &samples)
+{
+    if (patch_j < patch_i)
+        swap(patch_i, patch_j);
 
-    /* Offsets for indexing of patches in 1D-array */
-    int *offset = new int[n];
+    const int i = patch_tri[patch_i];
+    const int j = patch_tri[patch_j];
+
+    /* Own random sequence per patch pair, independent of the thread */
+    RNG rng(uint64_t(patch_i) * patch_num + patch_j);
     
-    for (int i = 0; i < n; i ++) {
-        offset[i] = 0;
-        for (int k = 0; k < i; k ++)
-            offset[i] += tris[k].patches.size();
-    }
+    return Sample_Form_Factor(
+        patch_sets[i].patches[patch_i - patch_offset[i]].data(), i, patch_area[patch_i],
+        patch_sets[j].patches[patch_j - patch_offset[j]].data(), j, patch_area[patch_j],
+        samples, rng);
+}
 
-    /* Loop over all triangles in scene */
-    for (int i = 0; i < n; i ++) {
-		
-        int patch_i = offset[i];	
-        cout << i << " "; 
+void Calculate_Form_Factors(const SampleTable &samples,
+                            FormFactorStorage storage) 
+{
+    /* Nonzero estimates of each row of the upper triangle */
+    vector<vector<FormFactorEntry>> upper(patch_num);
+
+    cout << "Using " << omp_get_max_threads() << " threads" << endl;
+    const double start_time = omp_get_wtime();
+    int rows_done = 0;
+
+    /* Every patch pair of the upper triangle (patch on triangle i, patch
+       on triangle j > i) is estimated independently and only once; 
+       each row is written by one thread only; rows get shorter towards
+       the end, so they are handed out to the threads dynamically */
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int patch_i = 0; patch_i < patch_num; patch_i ++) {
 		
-        /* Loop over all patches in triangles i */
-        for (unsigned long ip = 0; ip < tris[i].patches.size(); ip ++) {
-			
-            cout << "*" << flush;
-				
-            const Vector normal_i = tris[i].normal;
- 
-            int patch_j = 0;
-
-            /* Loop over all triangles in scene for triangle i */
-            for (int j = 0; j < n; j ++) {
-				
-				const Vector normal_j = tris[j].normal;
-
-				/* Loop over all patches in triangle j */
-                for (unsigned long jp = 0; jp < tris[j].patches.size(); jp ++) {
-                      				
-					/* Do not compute form factors for patches on same rectangle;
-						also exploit symmetry to reduce computation;
-                        intemediate values; will be divided by patch area below */
-					if (i < j) {
-						double F = 0;
-                                
-                                
-						vector<Vector> patches_i = tris[i].patches[patch_i - offset[i]];
-						vector<Vector> patches_j = tris[j].patches[patch_j - offset[j]];
-								
-						/* Uniform PDF for Monte Carlo (1/Ai)x(1/Aj) */
-						const double pdf = 
-							(1.0 / patch_area[offset[i] + ip]) *
-							(1.0 / patch_area[offset[j] + jp]);
-
-                        /* Determine rays of NixNi uniform samples of patch 
-							on i to NjxNj uniform samples of patch on j */
-                        for (int s = 0; s < (mc_sample*mc_sample); s ++) {
-                                    
-							/* Determine sample points xi, xj on both patches */
-                            const Vector xi = get_sample_point(patches_i[0], patches_i[1], 
-								patches_i[2]);
-                            const Vector xj = get_sample_point(patches_j[0], patches_j[1],
-								patches_j[2]);
-
-                            /* Check for visibility between sample points */
-                            const Vector ij = (xj - xi).Normalized();
-
-                            double t; 
-                            int id;
-                            Vector normal; 
-                            if (Intersect_Scene(Ray(xi, ij), &t, &id, &normal) && id != j) {
-								continue; /* If intersection with other rectangle */
-                            }
-
-                            /* Cosines of angles beteen normals and ray inbetween */
-                            const double d0 = normal_i.Dot(ij);
-                            const double d1 = normal_j.Dot(-1.0 * ij);
-
-                            /* Continue if patches facing each other */
-                            if (d0 > 0.0 && d1 > 0.0) {
-								/* Sample form factor */
-								const double K = d0 * d1 / (M_PI * (xj - xi).LengthSquared());
-
-                                /* Add weighted sample to estimate */
-								F += K / pdf;
-							}
-						} 
-
-                        /* Divide by number of samples */
-                        F /= (mc_sample) * (mc_sample); 
- 
-                        form_factor[patch_i * patch_num + patch_j] = F;
-					}
-                    patch_j ++;
-                        
-                }
-            }
-            patch_i ++;
+        const int i = patch_tri[patch_i];
+        
+        /* Loop over all patches of the triangles after triangle i; do not 
+           compute form factors for patches on same triangle and exploit
+           symmetry to reduce computation */
+        const int first_j = patch_offset[i] + patch_sets[i].patches.size();
+        for (int patch_j = first_j; patch_j < patch_num; patch_j ++) {
+            const double F = Estimate_Form_Factor(patch_i, patch_j, samples);
+            if (F > 0.0)
+                upper[patch_i].push_back({ patch_j, F });
         }
 
-        cout << endl;
+        int done;
+        #pragma omp atomic capture
+        done = ++rows_done;
+        if (omp_get_thread_num() == 0)
+            cout << "\r" << 100.0 * done / patch_num << "%     " << flush;
     }
+    cout << "\r100%     " << endl;
+    cout << "Form factors computed in " << omp_get_wtime() - start_time << " s" << endl;
 
-    /* Copy upper to lower triangular values */
-    for (int i = 0; i < patch_num-1; i ++) 
-    {
-        for (int j = i+1; j < patch_num; j ++) 
-        {
-             form_factor[j * patch_num + i] = form_factor[i * patch_num + j];
-        }
+    /* Copy upper to lower triangular values, divide by area to get 
+       final form factors and keep only the nonzeros */
+    form_factors.Build(upper, patch_area, storage);
+}
+
+/******************************************************************
+* Form factors row by row via hemisphere ray casting: every patch 
+* casts cosine-distributed rays from points spread over the patch; 
+* the fraction of rays that hits patch j estimates F_ij, so a row 
+* costs one set of rays instead of rays per patch pair. The hit
+* patch is found from the barycentric coordinates of the hit point.
+* As A_i F_ij = A_j F_ji, the mean of both estimates is stored.
+*******************************************************************/
+
+/* Cosine-distributed direction around normal n for e1, e2 in [0,1) */
+Vector Cosine_Direction(const Vector &n, double e1, double e2)
+{
+    const Vector u = ((fabs(n.x) > 0.1 ? Vector(0.0, 1.0, 0.0) : 
+                                         Vector(1.0, 0.0, 0.0)).Cross(n)).Normalized();
+    const Vector v = n.Cross(u);
+    const double r = sqrt(e1);
+    const double phi = 2.0 * M_PI * e2;
+    return (u * (cos(phi) * r) + v * (sin(phi) * r) + n * sqrt(1.0 - e1)).Normalized();
+}
+
+void Hemisphere_Row(const int patch_i, const SampleTable &rays, 
+                    vector<FormFactorEntry> &row)
+{
+    const int i = patch_tri[patch_i];
+    const vector<Vector> &patches_i = patch_sets[i].patches[patch_i - patch_offset[i]];
+    const Vector &normal_i = tris[i].normal;
+
+    /* Own random sequence per patch, separate from those of the pairs */
+    RNG rng(patch_i, 1);
+    double shift[4];
+    rays.Shift(rng, shift);
+
+    vector<int> hits;
+    hits.reserve(rays.count);
+    for (int s = 0; s < rays.count; s ++) {
+        double e[4];
+        rays.Get(s, shift, rng, e);
+        const Vector xi = get_sample_point(patches_i[0], patches_i[1], 
+            patches_i[2], e[0], e[1]);
+        const Vector dir = Cosine_Direction(normal_i, e[2], e[3]);
+
+        double t; 
+        int id;
+        Vector normal; 
+        if (!Intersect_Scene(Ray(xi, dir), &t, &id, &normal) || id == i)
+            continue;
+        
+        /* Patches only receive light on their front side */
+        if (normal.Dot(dir) >= 0.0)
+            continue;
+        hits.push_back(patch_offset[id] + patch_sets[id].locate(tris[id], xi + dir * t));
     }
 
-    /* Divide by area to get final form factors */
-    for (int i = 0; i < patch_num; i ++) 
-    {
-        for (int j = 0; j < patch_num; j ++) 
-        {
-             form_factor[i * patch_num + j] /= patch_area[i];
+    /* Count the hits per patch */
+    sort(hits.begin(), hits.end());
+    row.clear();
+    for (size_t k = 0; k < hits.size(); ) {
+        size_t end = k;
+        while (end < hits.size() && hits[end] == hits[k])
+            end ++;
+        row.push_back({ hits[k], double(end - k) / rays.count });
+        k = end;
+    }
+}
 
-             /* Clamp to [0,1] */
-             if(form_factor[i * patch_num + j] > 1.0) 
-                 form_factor[i * patch_num + j] = 1.0;
-		}
+void Calculate_Form_Factors_Hemisphere(const SampleTable &rays,
+                                       FormFactorStorage storage) 
+{
+    vector<vector<FormFactorEntry>> rows(patch_num);
+
+    cout << "Using " << omp_get_max_threads() << " threads" << endl;
+    const double start_time = omp_get_wtime();
+
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (int patch_i = 0; patch_i < patch_num; patch_i ++)
+        Hemisphere_Row(patch_i, rays, rows[patch_i]);
+
+    /* Half of A_i F_ij from row i and half of A_j F_ji from row j go
+       to the upper triangle entry (min(i, j), max(i, j)) */
+    vector<vector<FormFactorEntry>> upper(patch_num);
+    for (int patch_i = 0; patch_i < patch_num; patch_i ++) {
+        for (const FormFactorEntry &e : rows[patch_i]) {
+            const double AF = 0.5 * patch_area[patch_i] * e.value;
+            if (e.column > patch_i)
+                upper[patch_i].push_back({ e.column, AF });
+            else
+                upper[e.column].push_back({ patch_i, AF });
+        }
+        vector<FormFactorEntry>().swap(rows[patch_i]);
+    }
+    for (vector<FormFactorEntry> &row : upper) {
+        sort(row.begin(), row.end(), 
+             [](const FormFactorEntry &a, const FormFactorEntry &b) { 
+                 return a.column < b.column; 
+             });
+        size_t n = 0;
+        for (size_t k = 0; k < row.size(); k ++) {
+            if (n > 0 && row[n - 1].column == row[k].column)
+                row[n - 1].value += row[k].value;
+            else
+                row[n ++] = row[k];
+        }
+        row.resize(n);
     }
+    cout << "Form factors computed in " << omp_get_wtime() - start_time << " s" << endl;
+
+    form_factors.Build(upper, patch_area, storage);
+}
+
+void Print_Form_Factor_Stats()
+{
+    const double dense = double(patch_num) * patch_num;
+    cout << "Nonzero form factors: " << form_factors.NonZeros() << " of " << dense 
+         << " (" << 100.0 * form_factors.NonZeros() / dense << "%), " 
+         << form_factors.Bytes() / 1048576.0 << " MB as " << StorageName(form_factors.storage) 
+         << " (dense: " << dense * sizeof(double) / 1048576.0 << " MB)" << endl;
 }
 
 
 /******************************************************************
 * Iterative computation of radiosity via Gathering; i.e. solution
 * using Gauss-Seidel iteration - reuse already computed values;
-* run-time O(n^2) 
+* only the nonzero form factors are visited, run-time O(nonzeros)
 *******************************************************************/
 
 void Calculate_Radiosity(const int iteration) 
 {
-    const int n = tris.size();
-    int patch_i = 0;
+    /* Radiosity of every patch, updated in place */
+    vector<const Color *> radiosity(patch_num);
+    for (int patch_j = 0; patch_j < patch_num; patch_j ++) {
+        const int j = patch_tri[patch_j];
+        radiosity[patch_j] = &patch_sets[j].patch[patch_j - patch_offset[j]];
+    }
 	
-    for (int i = 0; i < n; i ++) {
-		
-        for (unsigned long ip = 0; ip < tris[i].patches.size(); ip ++)  {
-			
-            Color B;
-            int patch_j = 0;
-            
-			for (int j = 0; j < n; j ++) {
-				
-                for (unsigned long jp = 0; jp < tris[j].patches.size(); jp ++) {
-						
-					const double Fij = form_factor[patch_i * patch_num + patch_j];
-					 
-					/* Add form factor multiplied with radiosity of previous step */		
-					if (Fij > 0.0) {
-						B = B + Fij * tris[j].patch[jp];
-					}
-					patch_j ++;
-				}
-            }
-            /* Multiply sum with color of patch and add emission */
-            B = tris[i].color.MultComponents(B) + tris[i].emission;
-  
-            /* Store overall patch radiosity of current iteration */
-			tris[i].patch[ip] = B;
-			
-			patch_i ++;
-        }
+    for (int patch_i = 0; patch_i < patch_num; patch_i ++) {
+        const int i = patch_tri[patch_i];
+
+        /* Add form factors multiplied with radiosity of previous step */
+        Color B = form_factors.Gather(patch_i, radiosity);
+
+        /* Multiply sum with color of patch and add emission */
+        B = tris[i].color.MultComponents(B) + tris[i].emission;
+
+        /* Store overall patch radiosity of current iteration */
+        patch_sets[i].patch[patch_i - patch_offset[i]] = B;
     }
 }
 
 
 /******************************************************************
-* Helper functions for smooth barycentric interpolation 
-* Calculate all colors for a vertex.
-* These values are used in the Radiance function.
+* Progressive refinement radiosity via Shooting (Southwell iteration):
+* the patch with the most unshot power A_i * dB_i distributes it to
+* all other patches, B_j += rho_j * F_ji * dB_i with F_ji = A_i F_ij / A_j; 
+* stops once the unshot power is below tolerance times the emitted
+* power. Form factor rows are estimated when a patch is shot, so no
+* form factor matrix is stored.
 *******************************************************************/
 
-/* interpolate colors for a vertex */
-Color interpolate_vertex(vector<Color> data) {
-	Color to_return = Color(0.0, 0.0, 0.0);
-	
-	double i = data.size();
-	for(unsigned int i = 0; i < data.size(); i++) {
-		to_return = to_return + data[i];
-	}
-	
-	Color r = Color(
-		(to_return.x > 0 ? (to_return.x / i) : 0), 
-		(to_return.y > 0 ? (to_return.y / i) : 0), 
-		(to_return.z > 0 ? (to_return.z / i) : 0));
-	
-	return r;
+/* Power measure of a radiosity, mean over the color channels */
+static double Power(const Color &c) 
+{
+    return (c.x + c.y + c.z) / 3.0;
 }
 
-/* interpolate all vertices for a patch */
-vector<vector<Color>> patch_vertices_interpolation(
-	vector<vector<vector<Color>>> to_i) {
-	
-	vector<vector<Color>> colors1;
-	
-	for(vector<vector<Color>> patch_data : to_i){
-		vector<Color> patch_color;
-		for(vector<Color> vertex : patch_data){
-			patch_color.push_back(interpolate_vertex(vertex));
-		}
-		colors1.push_back(patch_color);
-	}
-	
-	return colors1;
-}
+int Shoot_Radiosity(const SampleTable &samples, const double tolerance) 
+{
+    /* Radiosity and unshot radiosity of every patch, start with emission */
+    vector<Color> unshot(patch_num);
+    for (int patch_i = 0; patch_i < patch_num; patch_i ++) {
+        const int i = patch_tri[patch_i];
+        patch_sets[i].patch[patch_i - patch_offset[i]] = tris[i].emission;
+        unshot[patch_i] = tris[i].emission;
+    }
 
-/* calculate all patch_vertex colors for triangle by interpolation */
-vector<vector<Color>> color_for_patch_vertices(Triangle tri) {
-	
-	vector<vector<Color>> colors;
-	vector<vector<vector<Color>>> to_interpolate;
-	
-	for(unsigned int pi = 0; pi < tri.tri_patches.size(); pi++) {
-		
-		vector<Color> vertex1;
-		vector<Color> vertex2;
-		vector<Color> vertex3;
-		
-		for(unsigned int t = 0; t < tris.size(); t++) {
-			if(tri.normal.Equals(tris[t].normal)) {
-				
-				for(unsigned int pj = 0; pj < tris[t].tri_patches.size(); pj++) {
-					
-					if(tri.tri_patches[pi].a.Equals(tris[t].tri_patches[pj].a) || 
-						tri.tri_patches[pi].a.Equals(tris[t].tri_patches[pj].b) ||
-						tri.tri_patches[pi].a.Equals(tris[t].tri_patches[pj].c)){
-						vertex1.push_back(tris[t].patch[pj]);
-					}
-					if(tri.tri_patches[pi].b.Equals(tris[t].tri_patches[pj].a) ||
-						tri.tri_patches[pi].b.Equals(tris[t].tri_patches[pj].b) ||
-						tri.tri_patches[pi].b.Equals(tris[t].tri_patches[pj].c)){
-						vertex2.push_back(tris[t].patch[pj]);
-					}
-					if(tri.tri_patches[pi].c.Equals(tris[t].tri_patches[pj].a) ||
-						tri.tri_patches[pi].c.Equals(tris[t].tri_patches[pj].b) ||
-						tri.tri_patches[pi].c.Equals(tris[t].tri_patches[pj].c)){
-						vertex3.push_back(tris[t].patch[pj]);
-					}
-					
-				}
-			}
-		}
-		
-		to_interpolate.push_back({vertex1, vertex2, vertex3});
-	}
-	
-	colors = patch_vertices_interpolation(to_interpolate);
-	
-	return colors;
+    double emitted = 0.0;
+    for (int patch_i = 0; patch_i < patch_num; patch_i ++)
+        emitted += Power(unshot[patch_i]) * patch_area[patch_i];
+
+    const double start_time = omp_get_wtime();
+    int shots = 0;
+    double residual = emitted;
+    
+    while (emitted > 0.0) {
+        /* Patch with most unshot power; total unshot power */
+        int shooter = 0;
+        double max_power = -1.0;
+        residual = 0.0;
+        for (int patch_i = 0; patch_i < patch_num; patch_i ++) {
+            const double power = Power(unshot[patch_i]) * patch_area[patch_i];
+            residual += power;
+            if (power > max_power) {
+                max_power = power;
+                shooter = patch_i;
+            }
+        }
+
+        if (residual <= tolerance * emitted)
+            break;
+
+        if (shots % 100 == 0)
+            cout << "\rShot " << shots << ", unshot power " 
+                 << 100.0 * residual / emitted << "%     " << flush;
+        
+        /* Shoot to all patches of the other triangles; every patch j is
+           updated by one thread only */
+        const Color dB = unshot[shooter];
+        unshot[shooter] = Color();
+        const int i = patch_tri[shooter];
+        const int first_i = patch_offset[i];
+        const int last_i = first_i + patch_sets[i].patches.size();
+
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (int patch_j = 0; patch_j < patch_num; patch_j ++) {
+            if (patch_j >= first_i && patch_j < last_i)
+                continue;
+            
+            const double AF = Estimate_Form_Factor(shooter, patch_j, samples);
+            if (AF <= 0.0)
+                continue;
+            
+            const int j = patch_tri[patch_j];
+            const double F_ji = min(AF / patch_area[patch_j], 1.0);
+            const Color delta = tris[j].color.MultComponents(dB) * F_ji;
+            
+            patch_sets[j].patch[patch_j - patch_offset[j]] = 
+                patch_sets[j].patch[patch_j - patch_offset[j]] + delta;
+            unshot[patch_j] = unshot[patch_j] + delta;
+        }
+        shots ++;
+    }
+
+    cout << "\r" << shots << " shots in " << omp_get_wtime() - start_time 
+         << " s, unshot power " << 100.0 * residual / emitted << "%     " << endl;
+    return shots;
 }
 
-/* calculate all vertex colors */
-vector<vector<vector<Color>>> all_vertex_colors () {
-	
-	vector<vector<vector<Color>>> vertex_colors;
-	
-	for(Triangle tri : tris) {
-		vertex_colors.push_back(color_for_patch_vertices(tri));
-	}
-	
-	return vertex_colors;
+
+/******************************************************************
+* Hierarchical radiosity: the patches of the triangles form quadtrees
+* that are only subdivided where links need it; the FF oracle refines
+* pairs with large form factors while linking, the BF oracle in 
+* addition refines links that transport much power between solver 
+* passes; the radiosity of the finest level is written back to the
+* uniform patches
+*******************************************************************/
+
+#define HIERARCHY_PASSES 8
+
+void Hierarchical_Radiosity(const SampleTable &samples, const int div_num, 
+                            RefinementOracle oracle, double ff_epsilon, double bf_epsilon)
+{
+    /* Node id for the random sequence: triangle, level and index */
+    auto node_key = [](const HNode &p) {
+        return (uint64_t(p.tri_id) << 48) | (uint64_t(p.level) << 40) | uint64_t(p.index);
+    };
+    
+    /* Pairs are always sampled in the order of their keys, so that
+       (p, q) and (q, p) give the same estimate */
+    auto estimate = [&](const HNode &p, const HNode &q) {
+        const HNode &first = node_key(p) < node_key(q) ? p : q;
+        const HNode &second = node_key(p) < node_key(q) ? q : p;
+        const Vector v1[3] = { first.tri.a, first.tri.b, first.tri.c };
+        const Vector v2[3] = { second.tri.a, second.tri.b, second.tri.c };
+        RNG rng(node_key(first), node_key(second));
+        return Sample_Form_Factor(v1, first.tri_id, first.tri.area, 
+                                  v2, second.tri_id, second.tri.area, samples, rng);
+    };
+
+    const double start_time = omp_get_wtime();
+    HierarchicalRadiosity hierarchy(tris, div_num, estimate);
+    hierarchy.Link(ff_epsilon);
+    cout << "Initial links: " << hierarchy.Links() << endl;
+
+    if (oracle == ORACLE_BF) {
+        for (int pass = 0; pass < HIERARCHY_PASSES; pass ++) {
+            hierarchy.Solve(1e-4, 100);
+            const int refined = hierarchy.RefineBF(bf_epsilon);
+            cout << "Pass " << pass << ": " << refined << " links refined, " 
+                 << hierarchy.Links() << " links" << endl;
+            if (refined == 0)
+                break;
+        }
+    }
+    const int iterations = hierarchy.Solve(1e-6, 200);
+
+    for (int i = 0; i < (int)tris.size(); i ++)
+        hierarchy.Leaves(i, patch_sets[i].patch);
+
+    const double pairs = double(patch_num) * patch_num;
+    cout << "Hierarchy: " << hierarchy.nodes.size() << " nodes, " << hierarchy.LeafCount() 
+         << " leaves of " << patch_num << " patches, " << hierarchy.Links() << " links ("
+         << 100.0 * hierarchy.Links() / pairs << "% of patch pairs), " 
+         << hierarchy.estimates << " form factor estimates" << endl;
+    cout << "Solved in " << iterations << " iterations, " 
+         << omp_get_wtime() - start_time << " s" << endl;
 }
 
-/* vertex color values */
-/* sorted by triangle -> patches -> (A Color, B Color, C Color) */
-vector<vector<vector<Color>>> triangle_vertex_colors;
+
+/******************************************************************
+* Vertex colors for smooth barycentric interpolation: the corners of
+* all patches are welded into shared vertices (same position and 
+* normal, so only coplanar patches share them); the color of a vertex
+* is the mean of the patches around it, added up in one linear pass.
+* These values are used in the Radiance function.
+*******************************************************************/
+
+/* Vertex of every patch corner, 3 per patch in global patch order */
+vector<int> corner_vertex;
+
+/* Color of every welded vertex */
+vector<Color> vertex_colors;
+
+void Calculate_Vertex_Colors() 
+{
+    /* Weld corners closer than a millionth of the scene size */
+    const AABB &bounds = scene_bvh.nodes[0].bounds;
+    VertexIndex vertices(1e-6 * (bounds.max - bounds.min).Length());
+
+    corner_vertex.assign(3 * patch_num, 0);
+    for (int patch_i = 0; patch_i < patch_num; patch_i ++) {
+        const int i = patch_tri[patch_i];
+        const Triangle &patch = patch_sets[i].tri_patches[patch_i - patch_offset[i]];
+        corner_vertex[3 * patch_i + 0] = vertices.Add(patch.a, tris[i].normal);
+        corner_vertex[3 * patch_i + 1] = vertices.Add(patch.b, tris[i].normal);
+        corner_vertex[3 * patch_i + 2] = vertices.Add(patch.c, tris[i].normal);
+    }
+
+    /* Scatter the patch colors to their corners */
+    vector<Color> sum(vertices.size());
+    vector<int> count(vertices.size(), 0);
+    for (int patch_i = 0; patch_i < patch_num; patch_i ++) {
+        const int i = patch_tri[patch_i];
+        const Color &B = patch_sets[i].patch[patch_i - patch_offset[i]];
+        for (int k = 0; k < 3; k ++) {
+            const int v = corner_vertex[3 * patch_i + k];
+            sum[v] = sum[v] + B;
+            count[v] ++;
+        }
+    }
+
+    vertex_colors.assign(vertices.size(), Color());
+    for (size_t v = 0; v < vertices.size(); v ++) {
+        vertex_colors[v] = Color(
+            (sum[v].x > 0 ? (sum[v].x / count[v]) : 0), 
+            (sum[v].y > 0 ? (sum[v].y / count[v]) : 0), 
+            (sum[v].z > 0 ? (sum[v].z / count[v]) : 0));
+    }
+    cout << "Vertex colors: " << vertices.size() << " vertices for " 
+         << 3 * patch_num << " patch corners" << endl;
+}
 
 /******************************************************************
 * Compute radiance from radiosity by shooting rays into the scene;
 * Radiance directly proportional to radiosity for assumed diffuse
 * emitters/surfaces (multiply by PI);
-* At intersections either constant patch color is returned or a
-* smoothly interpolated color using barycentric interpolation.
+* At intersections both the constant patch color and a smoothly 
+* interpolated color using barycentric interpolation are returned,
+* so that one intersection serves both images.
 *******************************************************************/
 
-Color Radiance(const Ray &ray, const int depth, bool interpolation = true) 
+void Radiance(const Ray &ray, Color &constant, Color &smooth) 
 {
     double t; 
     int id;  
@@ -483,60 +742,54 @@ Color Radiance(const Ray &ray, const int depth, bool interpolation = true)
 
     /* Find intersected rectangle */
     if (!Intersect_Scene(ray, &t, &id, &normal)) {
-        return BackgroundColor;    
+        constant = BackgroundColor;
+        smooth = BackgroundColor;
+        return;
     }
     
 
     /* Determine intersection point on rectangle */
-    Triangle &obj = tris[id];
+    const PatchSet &obj = patch_sets[id];
     const Vector hitpoint = ray.org + t * ray.dir; 
 
-    /* Determine intersected patch */    
-    int index = 0;
-    for(unsigned long ip = 0; ip < obj.tri_patches.size(); ip++){
-		if(obj.tri_patches[ip].intersect(ray) > 0.0){
-			index = ip;
-		}
-	}
-            
-    /* Barycentric interpolation for smooth image */
-    if (interpolation) {
-		
-		vector<Color> cs = triangle_vertex_colors[id][index];
-		
-		Triangle patch = obj.tri_patches[index];
-		
-		double a_to_h = (hitpoint - patch.a).Length();
-		double b_to_h = (hitpoint - patch.b).Length();
-		double c_to_h = (hitpoint - patch.c).Length();
-		
-		double a1 = area_of_triangle(c_to_h, b_to_h, 
-			(patch.c - patch.b).Length());
-		double a2 = area_of_triangle(a_to_h, c_to_h, 
-			(patch.c - patch.a).Length());
-		double a3 = area_of_triangle(a_to_h, b_to_h, 
-			(patch.b - patch.a).Length());
-			
-		double lambda1 = a1 / patch.area;
-		double lambda2 = a2 / patch.area;
-		double lambda3 = a3 / patch.area;
-		
-		Color interp = ((cs[0] * lambda1) + (cs[1] * lambda2)) + (cs[2] * lambda3);
-		
-		return interp;
-		
-    } else {         
-        return obj.patch[index];
-    }
+    /* Determine intersected patch from the barycentric coordinates */    
+    double u, v;
+    const int index = obj.locate(tris[id], hitpoint, &u, &v);
+
+    /* Constant color of the patch */
+    constant = obj.patch[index];
+
+    /* Barycentric interpolation of the vertex colors for smooth image */
+    const int *corners = &corner_vertex[3 * (patch_offset[id] + index)];
+    smooth = vertex_colors[corners[0]] * (1.0 - u - v) + 
+             vertex_colors[corners[1]] * u + 
+             vertex_colors[corners[2]] * v;
 }
 
 /******************************************************************
 * Main routine: Computation of radiosity image
 * Key parameters
-* - Image dimensions: width, height 
-* - Number of samples for antialiasing (non-uniform filter): samples 
+* - Image dimensions: -width w -height h (default 640 x 480)
+* - Number of samples for antialiasing (non-uniform filter): -samples n
+*   per subpixel (default 4)
 * - Number of patches along edges a,b: patches_a, patches_b
-* - Number of uniform samples per patch edge: MC_samples
+* - Number of samples per patch edge: -mcsamples n (default 3)
+* - Subdivision level of the triangles: -patchdiv n (default 2)
+* - Form factor sample points: -sampler uniform|stratified|halton
+*   (default stratified)
+* - Precision of the stored form factors: -storage double|float|quantized
+*   (default double)
+* - Form factor cache directory: -cache dir (default .), disabled
+*   with -nocache
+* - Radiosity solver: -solver gather|shoot|hierarchical (default gather);
+*   gathering uses the form factor matrix, shooting estimates form factor
+*   rows on demand and stops at -tolerance t (default 0.001) unshot power
+* - Hierarchical solver: -oracle ff|bf (default bf), form factor threshold
+*   -ffepsilon f (default 0.02), fraction of the emitted power per link
+*   -bfepsilon b (default 0.0001)
+* - Form factor estimator of the gathering solver: -estimator pairs|hemisphere
+*   (default pairs); the hemisphere estimator casts -hemirays n (default 32)
+*   times n rays per patch
 * - Number of iterations for iterative solver: iterations
 * Rendered result saved as PPM image file
 *******************************************************************/
@@ -550,6 +803,77 @@ int main(int argc, char **argv) {
     int width = 640;
     int height = 480;
     int samples = 4;
+    int patch_div = 2; /* There will be 4^patch_div triangular patches. */
+    int MC_samples = 3; /* There will be MC_sample * MC_sample samples per patch */
+    Sampler sampler = SAMPLER_STRATIFIED;
+    FormFactorStorage storage = FF_DOUBLE;
+    string cache_dir = ".";
+    bool use_cache = true;
+    string solver = "gather";
+    double tolerance = 0.001;
+    RefinementOracle oracle = ORACLE_BF;
+    double ff_epsilon = 0.02;
+    double bf_epsilon = 0.0001;
+    string estimator = "pairs";
+    int hemi_rays = 32;
+
+    for (int i = 1; i < argc; i ++) {
+        string arg = argv[i];
+        if (arg == "-mcsamples" && i + 1 < argc)
+            MC_samples = max(1, atoi(argv[++i]));
+        else if (arg == "-patchdiv" && i + 1 < argc)
+            patch_div = max(0, atoi(argv[++i]));
+        else if (arg == "-sampler" && i + 1 < argc) {
+            if (!ParseSampler(argv[++i], sampler)) {
+                cerr << "Unknown sampler " << argv[i] << endl;
+                return 1;
+            }
+        }
+        else if (arg == "-storage" && i + 1 < argc) {
+            if (!ParseStorage(argv[++i], storage)) {
+                cerr << "Unknown form factor storage " << argv[i] << endl;
+                return 1;
+            }
+        }
+        else if (arg == "-cache" && i + 1 < argc)
+            cache_dir = argv[++i];
+        else if (arg == "-nocache")
+            use_cache = false;
+        else if (arg == "-solver" && i + 1 < argc) {
+            solver = argv[++i];
+            if (solver != "gather" && solver != "shoot" && solver != "hierarchical") {
+                cerr << "Unknown solver " << solver << endl;
+                return 1;
+            }
+        }
+        else if (arg == "-tolerance" && i + 1 < argc)
+            tolerance = max(0.0, atof(argv[++i]));
+        else if (arg == "-oracle" && i + 1 < argc) {
+            if (!ParseOracle(argv[++i], oracle)) {
+                cerr << "Unknown refinement oracle " << argv[i] << endl;
+                return 1;
+            }
+        }
+        else if (arg == "-ffepsilon" && i + 1 < argc)
+            ff_epsilon = max(0.0, atof(argv[++i]));
+        else if (arg == "-bfepsilon" && i + 1 < argc)
+            bf_epsilon = max(0.0, atof(argv[++i]));
+        else if (arg == "-estimator" && i + 1 < argc) {
+            estimator = argv[++i];
+            if (estimator != "pairs" && estimator != "hemisphere") {
+                cerr << "Unknown form factor estimator " << estimator << endl;
+                return 1;
+            }
+        }
+        else if (arg == "-hemirays" && i + 1 < argc)
+            hemi_rays = max(1, atoi(argv[++i]));
+        else if (arg == "-width" && i + 1 < argc)
+            width = max(1, atoi(argv[++i]));
+        else if (arg == "-height" && i + 1 < argc)
+            height = max(1, atoi(argv[++i]));
+        else if (arg == "-samples" && i + 1 < argc)
+            samples = max(1, atoi(argv[++i]));
+    }
 
     /* Set camera origin and viewing direction (negative z direction) */
     Ray camera(Vector(50.0, 52.0, 295.6), Vector(0.0, -0.042612, -1.0).Normalized());
@@ -562,37 +886,81 @@ int main(int argc, char **argv) {
     Image img(width, height);
     Image img_interpolated(width, height);
 
-    cout << "Calculating form factors" << endl;
-    int patch_div = 2; /* There will be 4^patch_div triangular patches. */
-    int MC_samples = 3; /* There will be MC_sample * MC_sample samples per patch */
-
-    Calculate_Form_Factors(patch_div, MC_samples);
+    Init_Patches(patch_div);
+
+    if (solver == "shoot") {
+        /* Progressive refinement, form factors estimated per shot */
+        cout << "Shooting radiosity (" << MC_samples * MC_samples << " " 
+             << SamplerName(sampler) << " samples per patch pair, tolerance " 
+             << tolerance << ")" << endl;
+        Shoot_Radiosity(SampleTable(sampler, MC_samples), tolerance);
+    } else if (solver == "hierarchical") {
+        /* Adaptive subdivision, down to the uniform patches at most */
+        cout << "Hierarchical radiosity (" << MC_samples * MC_samples << " " 
+             << SamplerName(sampler) << " samples per link, " << OracleName(oracle) 
+             << " oracle)" << endl;
+        Hierarchical_Radiosity(SampleTable(sampler, MC_samples), patch_div, oracle,
+                               ff_epsilon, bf_epsilon);
+    } else {
+        /* Form factors are taken from the cache if the geometry and the
+           form factor parameters did not change */
+        const bool hemisphere = estimator == "hemisphere";
+        const uint64_t key = Form_Factor_Key(patch_div, hemisphere ? hemi_rays : MC_samples, 
+                                             sampler, storage, hemisphere);
+        char key_name[32];
+        snprintf(key_name, sizeof(key_name), "%016llx", (unsigned long long)key);
+        const string cache_file = cache_dir + "/form_factors_" + key_name + ".cache";
+
+        if (use_cache && form_factors.Load(cache_file, key, patch_num, storage)) {
+            cout << "Form factors loaded from " << cache_file << endl;
+        } else {
+            if (hemisphere) {
+                cout << "Calculating form factors (" << hemi_rays * hemi_rays << " " 
+                     << SamplerName(sampler) << " hemisphere rays per patch)" << endl;
+                Calculate_Form_Factors_Hemisphere(SampleTable(sampler, hemi_rays), storage);
+            } else {
+                cout << "Calculating form factors (" << MC_samples * MC_samples << " " 
+                     << SamplerName(sampler) << " samples per patch pair)" << endl;
+                Calculate_Form_Factors(SampleTable(sampler, MC_samples), storage);
+            }
+            if (use_cache && form_factors.Save(cache_file, key))
+                cout << "Form factors saved to " << cache_file << endl;
+        }
+        Print_Form_Factor_Stats();
 
-    /* Iterative solution of radiosity linear system */
-    cout << "Calculating radiosity" << endl;
-    int iterations = 40; 
-    for (int i = 0; i < iterations; i ++) 
-    {
-        cout << i << " ";
-        Calculate_Radiosity(i);
+        /* Iterative solution of radiosity linear system */
+        cout << "Calculating radiosity" << endl;
+        int iterations = 40; 
+        for (int i = 0; i < iterations; i ++) 
+        {
+            cout << i << " ";
+            Calculate_Radiosity(i);
+        }
+        cout << endl;
     }
-    cout << endl;
  
 	/* Calculate colors for each vertex */
-	triangle_vertex_colors = all_vertex_colors();
+	Calculate_Vertex_Colors();
  
-    /* Loop over image rows */
+    /* Loop over image rows; rows are independent and every pixel has
+       its own random sequence, so the image does not depend on the
+       number of threads */
+    cout << "Rendering " << width << "x" << height << " (" << samples * 4 << " spp) with "
+         << omp_get_max_threads() << " threads" << endl;
+    const double render_start = omp_get_wtime();
+    int rows_done = 0;
+
+    #pragma omp parallel for schedule(dynamic, 1)
     for (int y = 0; y < height; y ++) 
     {
-        cout << "\rRendering (" << samples * 4 << " spp) " << (100.0 * y / (height - 1)) << "%     ";
-        srand(y * y * y);
-
         /* Loop over row pixels */
         for (int x = 0; x < width; x ++) 
         {
             img.setColor(x, y, Color());
             img_interpolated.setColor(x, y, Color());
 
+            RNG rng(uint64_t(y) * width + x);
+
             /* 2x2 subsampling per pixel */
             for (int sy = 0; sy < 2; sy ++) 
             {
@@ -604,8 +972,8 @@ int main(int argc, char **argv) {
                     /* Computes radiance at subpixel using multiple samples */
                     for (int s = 0; s < samples; s ++) 
                     {
-                        const double r1 = 2.0 * drand48();
-                        const double r2 = 2.0 * drand48();
+                        const double r1 = 2.0 * rng.Next();
+                        const double r2 = 2.0 * rng.Next();
 
                         /* Transform uniform into non-uniform filter samples */
                         double dx;
@@ -628,13 +996,11 @@ int main(int argc, char **argv) {
                         /* Extend camera ray to start inside box */
                         Vector start = camera.org + dir * 130.0;
 
-                        /* Determine constant radiance */
-                        accumulated_radiance = accumulated_radiance + 
-                            Radiance(Ray(start, dir.Normalized()), 0, false) / samples;
-
-                        /* Determine interpolated radiance */
-                        accumulated_radiance2 = accumulated_radiance2 + 
-                            Radiance(Ray(start, dir.Normalized()), 0, true) / samples;
+                        /* Determine constant and interpolated radiance */
+                        Color constant, smooth;
+                        Radiance(Ray(start, dir.Normalized()), constant, smooth);
+                        accumulated_radiance = accumulated_radiance + constant / samples;
+                        accumulated_radiance2 = accumulated_radiance2 + smooth / samples;
                     }
 
                     img.addColor(x, y, accumulated_radiance);
@@ -642,12 +1008,20 @@ int main(int argc, char **argv) {
                  }
             }
         }
+
+        int done;
+        #pragma omp atomic capture
+        done = ++rows_done;
+        if (omp_get_thread_num() == 0)
+            cout << "\r" << 100.0 * done / height << "%     " << flush;
     }
 
-    cout << endl;
+    cout << "\r100%     " << endl;
+    cout << "Rendered in " << omp_get_wtime() - render_start << " s" << endl;
 	
-    img.Save(string("image_patches.ppm"));
-    img_interpolated.Save(string("image_smooth.ppm"));
+    bool saved = img.Save(string("image_patches.ppm"));
+    saved = img_interpolated.Save(string("image_smooth.ppm")) && saved;
+    return saved ? 0 : 1;
 }
 
 /**********************************************************************
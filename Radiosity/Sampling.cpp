@@ -0,0 +1,85 @@
+#include "Sampling.hpp"
+
+#include <algorithm>
+
+/* Radical inverse of i in the given base (van der Corput sequence) */
+static double RadicalInverse(int i, int base) {
+	const double inv_base = 1.0 / base;
+	double inv = inv_base;
+	double result = 0.0;
+	while (i > 0) {
+		result += (i % base) * inv;
+		i /= base;
+		inv *= inv_base;
+	}
+	return result;
+}
+
+SampleTable::SampleTable(Sampler sampler_, int mc_sample) :
+	sampler(sampler_), count(mc_sample * mc_sample), cell(1.0 / mc_sample), 
+	points(4 * mc_sample * mc_sample, 0.0) {
+	
+	if (sampler == SAMPLER_STRATIFIED) {
+		/* Fixed shuffle of the strata of patch j */
+		vector<int> order(count);
+		for (int s = 0; s < count; s++)
+			order[s] = s;
+		RNG rng(0x5eed);
+		for (int s = count - 1; s > 0; s--)
+			swap(order[s], order[rng.NextUInt() % (s + 1)]);
+		
+		/* Lower corners of the strata */
+		for (int s = 0; s < count; s++) {
+			points[4*s + 0] = (s % mc_sample) * cell;
+			points[4*s + 1] = (s / mc_sample) * cell;
+			points[4*s + 2] = (order[s] % mc_sample) * cell;
+			points[4*s + 3] = (order[s] / mc_sample) * cell;
+		}
+	} else if (sampler == SAMPLER_HALTON) {
+		const int bases[4] = { 2, 3, 5, 7 };
+		for (int s = 0; s < count; s++)
+			for (int d = 0; d < 4; d++)
+				points[4*s + d] = RadicalInverse(s + 1, bases[d]);
+	}
+}
+
+void SampleTable::Shift(RNG &rng, double shift[4]) const {
+	for (int d = 0; d < 4; d++)
+		shift[d] = sampler == SAMPLER_HALTON ? rng.Next() : 0.0;
+}
+
+void SampleTable::Get(int s, const double shift[4], RNG &rng, double e[4]) const {
+	const double *p = &points[4*s];
+	for (int d = 0; d < 4; d++) {
+		if (sampler == SAMPLER_UNIFORM) {
+			e[d] = rng.Next();
+		} else if (sampler == SAMPLER_STRATIFIED) {
+			e[d] = p[d] + rng.Next() * cell;
+		} else {
+			e[d] = p[d] + shift[d];
+			if (e[d] >= 1.0) 
+				e[d] -= 1.0;
+		}
+	}
+}
+
+bool ParseSampler(const string &name, Sampler &sampler) {
+	if (name == "uniform") 
+		sampler = SAMPLER_UNIFORM;
+	else if (name == "stratified") 
+		sampler = SAMPLER_STRATIFIED;
+	else if (name == "halton") 
+		sampler = SAMPLER_HALTON;
+	else 
+		return false;
+	return true;
+}
+
+const char *SamplerName(Sampler sampler) {
+	switch (sampler) {
+		case SAMPLER_UNIFORM: return "uniform";
+		case SAMPLER_STRATIFIED: return "stratified";
+		case SAMPLER_HALTON: return "halton";
+	}
+	return "unknown";
+}
@@ -0,0 +1,39 @@
+#ifndef _SAMPLING_H_
+#define _SAMPLING_H_
+
+#include <string>
+#include <vector>
+
+#include "Random.hpp"
+
+using namespace std;
+
+enum Sampler { SAMPLER_UNIFORM, SAMPLER_STRATIFIED, SAMPLER_HALTON };
+
+/* Precomputed points in [0,1)^4 for the form factor estimation of a
+   patch pair; the first two coordinates place a sample on patch i,
+   the last two on patch j. Each pair randomizes the table with its
+   own generator (jitter inside the strata, or a random toroidal shift
+   of the Halton points), so every estimate stays unbiased.
+   - SAMPLER_UNIFORM: independent uniform points (table unused)
+   - SAMPLER_STRATIFIED: m x m strata on each patch; the strata of
+     patch j are visited in shuffled order to decorrelate both patches
+   - SAMPLER_HALTON: Halton sequence in bases 2, 3, 5, 7 */
+struct SampleTable {
+	Sampler sampler;
+	int count;				/* Number of samples per patch pair */
+	double cell;			/* Edge length of a stratum */
+	vector<double> points;	/* Four values per sample */
+
+	SampleTable(Sampler sampler_, int mc_sample);
+
+	/* Randomization of the table for one patch pair */
+	void Shift(RNG &rng, double shift[4]) const;
+	/* Coordinates e[4] of sample s, given the shift of the pair */
+	void Get(int s, const double shift[4], RNG &rng, double e[4]) const;
+};
+
+bool ParseSampler(const string &name, Sampler &sampler);
+const char *SamplerName(Sampler sampler);
+
+#endif // _SAMPLING_H_
@@ -1,158 +1,19 @@
 #include "Structs.hpp"
 
 /*------------------------------------------------------------------
-| Struct for standard vector operations in 3D 
-| (used for points, vectors, and colors)
-------------------------------------------------------------------*/
-
-Vector::Vector(const Vector &b) : x(b.x), y(b.y), z(b.z) {}
-Vector::Vector(double x_, double y_, double z_) : x(x_), y(y_), z(z_) {}
-
-Vector Vector::operator+(const Vector &b) const {
-	return Vector(x + b.x, y + b.y, z + b.z);
-}
-
-Vector Vector::operator-(const Vector &b) const {
-    return Vector(x - b.x, y - b.y, z - b.z);
-}
-
-Vector Vector::operator/(double c) const {
-	return Vector(x / c, y / c, z / c);
-}
-
-Vector Vector::operator*(double c) const {
-    return Vector(x * c, y * c, z * c);
-}
-
-Vector Vector::MultComponents(const Vector &b) const {
-	return Vector(x * b.x, y * b.y, z * b.z);
-}
-
-double Vector::LengthSquared() const { 
-	return x*x + y*y + z*z; 
-}
-
-double Vector::Length() const { 
-	return sqrt(LengthSquared()); 
-} 
-
-Vector Vector::Normalized() const {
-	return Vector(x, y, z) / sqrt(x*x + y*y + z*z);
-}
-
-double Vector::Dot(const Vector &b) const {
-    return x * b.x + y * b.y + z * b.z;
-}
-
-Vector Vector::Cross(const Vector &b) const {
-	return Vector((y * b.z) - (z * b.y), 
-				  (z * b.x) - (x * b.z), 
-                  (x * b.y) - (y * b.x));
-}
-    
-Vector Vector::Invert() const {
-	return Vector(-x, -y, -z);
-}
-
-bool Vector::Equals(const Vector &b) const {
-	if(x == b.x && y == b.y && z == b.z){
-		return true;
-	} else {
-		return false;
-	}
-}
-
-/*------------------------------------------------------------------
-| Structure for rays (e.g. viewing ray, ray tracing)
-------------------------------------------------------------------*/
-
-Ray::Ray(const Vector org_, const Vector &dir_) : org(org_), dir(dir_) {}
-
-/*------------------------------------------------------------------
-| Struct holds pixels/colors of rendered image
-------------------------------------------------------------------*/
-
-Image::Image(int _w, int _h) : width(_w), height(_h) {
-	pixels = new Color[width * height];        
-}
-
-Color Image::getColor(int x, int y) {
-	int image_index = (height-y-1) * width + x;	
-	return pixels[image_index];
-}
-
-void Image::setColor(int x, int y, const Color &c) {
-	int image_index = (height-y-1) * width + x;	
-	pixels[image_index] = c;
-}
-
-void Image::addColor(int x, int y, const Color &c) {
-	int image_index = (height-y-1) * width + x;	
-	pixels[image_index] = pixels[image_index] + c;
-}
-
-int Image::toInteger(double x) { 
-	/* Clamp to [0,1] */
-	if (x<0.0) x = 0.0;		
-        
-	if (x>1.0) x = 1.0;             
-
-	/* Apply gamma correction and convert to integer */
-	return int(pow(x,1/2.2)*255+.5); 
-}
-
-void Image::Save(const string &filename) {
-	/* Save image in PPM format */
-	FILE *f = fopen(filename.c_str(), "wb");
-	fprintf(f, "P3\n%d %d\n%d\n", width, height, 255);
-	for (int i = 0; i < width * height; i++)
-	fprintf(f,"%d %d %d ", toInteger(pixels[i].x), 
-							toInteger(pixels[i].y), 
-							toInteger(pixels[i].z));
-	fclose(f);
-}
-
-/*------------------------------------------------------------------
-| Basic geometric element of scene description;
 | Triangles are subdivided into smaller patches for radiosity
-| computation (subdivision equal for all triangle)
+| computation (subdivision equal for all triangle), which are
+| stored separately in a PatchSet per triangle
 ------------------------------------------------------------------*/
 
-/* help function for triangle */
-double area_of_triangle(double a, double b, double c) {
-	double s = (a+b+c)/2;
-	return sqrt(s*(s-a)*(s-b)*(s-c));
-}
-
-/* function to calc normal for triangle */
-Vector calc_normal(Vector a, Vector b, Vector c){
-	Vector u = b - a;
-	Vector v = c - a;
-	
-	return u.Cross(v);
-}
-
-Triangle::Triangle( const Vector p0_, const Vector &a_, const Vector &b_, 
-					const Color &emission_, const Color &color_) :
-	a(p0_), edge_a(a_), edge_b(b_), emission(emission_), color(color_){
-		
-	b = a + edge_a;
-	c = a + edge_b;
-	normal = calc_normal(a, b, c).Normalized();
-	a_len = edge_a.Length();
-	b_len = edge_b.Length();
-	double a_to_b = (a - b).Length();
-	double a_to_c = (a - c).Length();
-	double b_to_c = (b - c).Length();	
-	area = area_of_triangle(a_to_b, a_to_c, b_to_c);
-}
-
-void Triangle::calc_patches() {
+void PatchSet::calc_patches(const Triangle &tri) {
 	vector<vector<Vector>> ps;
 	vector<Triangle> ts;
-		
-	patches.push_back({a, b, c});
-	tri_patches.push_back(Triangle(a, b - a, c - a, emission, color));
+	
+	patches.clear();
+	tri_patches.clear();
+	patches.push_back({tri.a, tri.b, tri.c});
+	tri_patches.push_back(tri);
 		
 	for(int d = 0; d < div_num; d++) {
 		ps = patches;
@@ -162,70 +23,60 @@ void Triangle::calc_patches() {
 		unsigned int size  = ts.size();
 			
 		for(unsigned int e = 0; e < size; e++){
-			/* divide triangle in 4 subtriangles */
-			Triangle t1 = Triangle(ts[e].a, (ts[e].a + (ts[e].edge_a / 2)) - ts[e].a,
-				(ts[e].a + (ts[e].edge_b / 2)) - ts[e].a, ts[e].emission, ts[e].color);
-			Triangle t2 = Triangle(t1.b, ts[e].b - t1.b, 
-				(t1.b + (ts[e].edge_b / 2)) - t1.b, ts[e].emission, ts[e].color);
-			Triangle t3 = Triangle(t2.c, t1.c - t2.c, t2.a - t2.c, ts[e].emission,
-				ts[e].color);
-			Triangle t4 = Triangle(t1.c, t2.c - t1.c, ts[e].c - t1.c, ts[e].emission,
-				ts[e].color);
+			/* divide triangle in 4 subtriangles; child k of patch e
+			   gets index 4 * e + k on the next level */
+			const Triangle &parent = ts[e];
+			Triangle t[4] = { parent, parent, parent, parent };
+			parent.subdivide(t);
 			
-			tri_patches.push_back(t1);
-			patches.push_back({t1.a, t1.b, t1.c});
-			tri_patches.push_back(t2);
-			patches.push_back({t2.a, t2.b, t2.c});
-			tri_patches.push_back(t3);
-			patches.push_back({t3.a, t3.b, t3.c});
-			tri_patches.push_back(t4);
-			patches.push_back({t4.a, t4.b, t4.c});
-				
+			for(int k = 0; k < 4; k++){
+				tri_patches.push_back(t[k]);
+				patches.push_back({t[k].a, t[k].b, t[k].c});
+			}
+		}
+	}
+}
+
+int PatchSet::locate(const Triangle &tri, const Vector &p, 
+                     double *u_patch, double *v_patch) const {
+	/* p = a + u * edge_a + v * edge_b */
+	const Vector ap = p - tri.a;
+	const double d00 = tri.edge_a.Dot(tri.edge_a);
+	const double d01 = tri.edge_a.Dot(tri.edge_b);
+	const double d11 = tri.edge_b.Dot(tri.edge_b);
+	const double d20 = ap.Dot(tri.edge_a);
+	const double d21 = ap.Dot(tri.edge_b);
+	const double denom = d00 * d11 - d01 * d01;
+	double u = (d11 * d20 - d01 * d21) / denom;
+	double v = (d00 * d21 - d01 * d20) / denom;
+	
+	/* Child k of Triangle::subdivide in local coordinates of the parent:
+	   0 at corner a, 1 at corner b, 3 at corner c, 2 in the middle 
+	   (with flipped edges) */
+	int index = 0;
+	for(int d = 0; d < div_num; d++) {
+		int k;
+		if(u >= 0.5) {
+			k = 1; u = 2 * u - 1; v = 2 * v;
+		} else if(v >= 0.5) {
+			k = 3; u = 2 * u; v = 2 * v - 1;
+		} else if(u + v <= 0.5) {
+			k = 0; u = 2 * u; v = 2 * v;
+		} else {
+			k = 2; u = 1 - 2 * u; v = 1 - 2 * v;
 		}
+		index = 4 * index + k;
 	}
+	if(u_patch) *u_patch = u;
+	if(v_patch) *v_patch = v;
+	return index;
 }
 
-void Triangle::init_patchs(const int num_) {
+void PatchSet::init_patchs(const Triangle &tri, const int num_) {
 	div_num = num_;
 	patch.clear();
 	patch.resize(pow(4, num_));
-	calc_patches();
-}
-
-/* Triangle-ray intersection test. */
-/* Implementation of the Möller-Trumbore intersection algorithm */
-/* based on wikipedia.org */
-double Triangle::intersect(const Ray &ray) {
-		
-	static const double EPSILON = 0.0000001;
-	Vector b_to_a = b - a;
-	Vector c_to_a = c - a;
-
-	Vector h = ray.dir.Cross(c_to_a);
-	double ax = b_to_a.Dot(h);
-
-	if (ax > -EPSILON && ax < EPSILON)
-		return 0.0;
-
-	double f = 1.0 / ax;
-	Vector s = ray.org - a;
-	double u = f * s.Dot(h);
-
-	if (u < 0.0 || u > 1.0)
-		return 0.0;
-
-	Vector q = s.Cross(b_to_a);
-	double v = f * ray.dir.Dot(q);
-
-	if (v < 0.0 || u + v > 1.0)
-		return 0.0;
-
-	double t = f * c_to_a.Dot(q);
-
-	if (t <= EPSILON)
-		return 0.0;
-
-	return t;
+	calc_patches(tri);
 }
 
 /*------------------------------------------------------------------
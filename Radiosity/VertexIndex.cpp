@@ -0,0 +1,47 @@
+#include "VertexIndex.hpp"
+
+/* Normals count as equal if they deviate by less than ~0.1 degree */
+static const double NORMAL_COS_TOLERANCE = 1.0 - 1e-6;
+
+VertexIndex::VertexIndex(double tolerance_) : tolerance(tolerance_) {}
+
+void VertexIndex::Cell(const Vector &p, int64_t c[3]) const {
+	c[0] = int64_t(floor(p.x / tolerance));
+	c[1] = int64_t(floor(p.y / tolerance));
+	c[2] = int64_t(floor(p.z / tolerance));
+}
+
+uint64_t VertexIndex::CellKey(int64_t x, int64_t y, int64_t z) {
+	return (uint64_t(x) * 73856093ULL) ^ (uint64_t(y) * 19349663ULL) ^ 
+	       (uint64_t(z) * 83492791ULL);
+}
+
+int VertexIndex::Add(const Vector &p, const Vector &n) {
+	int64_t c[3];
+	Cell(p, c);
+	
+	/* Points within tolerance lie in this cell or a neighbouring one;
+	   different cells may share a key, so every candidate is checked */
+	const double tolerance2 = tolerance * tolerance;
+	for (int64_t dx = -1; dx <= 1; dx++)
+		for (int64_t dy = -1; dy <= 1; dy++)
+			for (int64_t dz = -1; dz <= 1; dz++) {
+				auto cell = cells.find(CellKey(c[0] + dx, c[1] + dy, c[2] + dz));
+				if (cell == cells.end())
+					continue;
+				for (int v : cell->second)
+					if ((positions[v] - p).LengthSquared() <= tolerance2 && 
+					    normals[v].Dot(n) >= NORMAL_COS_TOLERANCE)
+						return v;
+			}
+	
+	const int v = positions.size();
+	positions.push_back(p);
+	normals.push_back(n);
+	cells[CellKey(c[0], c[1], c[2])].push_back(v);
+	return v;
+}
+
+size_t VertexIndex::size() const {
+	return positions.size();
+}
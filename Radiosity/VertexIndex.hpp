@@ -0,0 +1,34 @@
+#ifndef _VERTEXINDEX_H_
+#define _VERTEXINDEX_H_
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "Structs.hpp"
+
+using namespace std;
+
+/* Welds points into shared vertices: points closer than tolerance 
+   with the same normal get the same vertex id. Candidates are found
+   in a spatial hash with cells of the tolerance size, so adding a 
+   point only looks at the 27 cells around it. */
+struct VertexIndex {
+	double tolerance;
+	vector<Vector> positions;
+	vector<Vector> normals;
+	
+	VertexIndex(double tolerance_);
+	
+	/* Id of the vertex at p with normal n, created if not found */
+	int Add(const Vector &p, const Vector &n);
+	size_t size() const;
+
+private:
+	unordered_map<uint64_t, vector<int>> cells;
+	
+	void Cell(const Vector &p, int64_t c[3]) const;
+	static uint64_t CellKey(int64_t x, int64_t y, int64_t z);
+};
+
+#endif // _VERTEXINDEX_H_
@@ -0,0 +1,374 @@
+#include "BVH.hpp"
+
+#include <algorithm>
+
+/*------------------------------------------------------------------
+| Axis-aligned bounding box used by the hierarchy.
+------------------------------------------------------------------*/
+
+AABB::AABB() : min(1e30, 1e30, 1e30), max(-1e30, -1e30, -1e30) {}
+
+void AABB::Extend(const Vector &p) {
+	min = Vector(fmin(min.x, p.x), fmin(min.y, p.y), fmin(min.z, p.z));
+	max = Vector(fmax(max.x, p.x), fmax(max.y, p.y), fmax(max.z, p.z));
+}
+
+void AABB::Extend(const AABB &b) {
+	min = Vector(fmin(min.x, b.min.x), fmin(min.y, b.min.y), fmin(min.z, b.min.z));
+	max = Vector(fmax(max.x, b.max.x), fmax(max.y, b.max.y), fmax(max.z, b.max.z));
+}
+
+Vector AABB::Centroid() const {
+	return (min + max) * 0.5;
+}
+
+double AABB::SurfaceArea() const {
+	Vector d = max - min;
+	if (d.x < 0.0 || d.y < 0.0 || d.z < 0.0)
+		return 0.0;
+	return 2.0 * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+/* Slab test; returns entry distance of ray into box in t_near */
+bool AABB::Intersect(const Ray &ray, const Vector &inv_dir, double t_max,
+                     double &t_near) const {
+	double tx1 = (min.x - ray.org.x) * inv_dir.x;
+	double tx2 = (max.x - ray.org.x) * inv_dir.x;
+	double t0 = fmin(tx1, tx2);
+	double t1 = fmax(tx1, tx2);
+
+	double ty1 = (min.y - ray.org.y) * inv_dir.y;
+	double ty2 = (max.y - ray.org.y) * inv_dir.y;
+	t0 = fmax(t0, fmin(ty1, ty2));
+	t1 = fmin(t1, fmax(ty1, ty2));
+
+	double tz1 = (min.z - ray.org.z) * inv_dir.z;
+	double tz2 = (max.z - ray.org.z) * inv_dir.z;
+	t0 = fmax(t0, fmin(tz1, tz2));
+	t1 = fmin(t1, fmax(tz1, tz2));
+
+	t_near = t0;
+	return t1 >= fmax(t0, 0.0) && t0 < t_max;
+}
+
+/*------------------------------------------------------------------
+| Bounding volume hierarchy over spheres and triangles of the
+| scene. Built top-down with the surface area heuristic (SAH),
+| evaluated over a fixed number of centroid bins per axis.
+------------------------------------------------------------------*/
+
+static const int SAH_BINS = 16;
+static const double INTERSECTION_COST = 1.0;
+
+/* Triangles are intersected PACKET_WIDTH at a time, so the SAH
+   counts packets rather than primitives */
+static int PacketCount(int n) {
+	return (n + PACKET_WIDTH - 1) / PACKET_WIDTH;
+}
+
+BVH::BVH(int max_leaf_size_, double traversal_cost_) : 
+	spheres(nullptr), tris(nullptr), max_leaf_size(max_leaf_size_), 
+	traversal_cost(traversal_cost_) {}
+
+AABB BVH::PrimitiveBounds(const Primitive &p) const {
+	AABB b;
+	if (p.type == SPH) {
+		const Sphere &s = (*spheres)[p.id];
+		Vector r(s.radius, s.radius, s.radius);
+		b.Extend(s.position - r);
+		b.Extend(s.position + r);
+	} else {
+		const Triangle &tri = (*tris)[p.id];
+		b.Extend(tri.a);
+		b.Extend(tri.a + tri.edge_a);
+		b.Extend(tri.a + tri.edge_b);
+	}
+	return b;
+}
+
+void BVH::Build(const vector<Sphere> &spheres_, const vector<Triangle> &tris_) {
+	spheres = &spheres_;
+	tris = &tris_;
+
+	prims.clear();
+	nodes.clear();
+
+	for (size_t i = 0; i < spheres->size(); i++)
+		prims.push_back({SPH, i});
+	for (size_t i = 0; i < tris->size(); i++)
+		prims.push_back({TRI, i});
+
+	/* Bounds and centroids are kept parallel to prims during the build */
+	vector<AABB> bounds(prims.size());
+	vector<Vector> centroids(prims.size());
+	for (size_t i = 0; i < prims.size(); i++) {
+		bounds[i] = PrimitiveBounds(prims[i]);
+		centroids[i] = bounds[i].Centroid();
+	}
+
+	nodes.reserve(2 * prims.size() + 1);
+	BVHNode root;
+	root.left_first = 0;
+	root.count = prims.size();
+	nodes.push_back(root);
+	Subdivide(0, 0, bounds, centroids);
+	BuildPackets();
+}
+
+/* Scene made of triangles only */
+void BVH::Build(const vector<Triangle> &tris_) {
+	static const vector<Sphere> no_spheres;
+	Build(no_spheres, tris_);
+}
+
+/* Sort spheres of each leaf to the front and pack its triangles */
+void BVH::BuildPackets() {
+	packets.clear();
+
+	for (BVHNode &node : nodes) {
+		node.packet_first = packets.size();
+		node.packet_count = 0;
+		if (node.count == 0)
+			continue;
+
+		vector<Primitive>::iterator first = prims.begin() + node.left_first;
+		vector<Primitive>::iterator tri_first = stable_partition(first, 
+			first + node.count, [](const Primitive &p) { return p.type == SPH; });
+
+		int lane = PACKET_WIDTH;
+		for (vector<Primitive>::iterator p = tri_first; p != first + node.count; ++p) {
+			if (lane == PACKET_WIDTH) {
+				packets.push_back(TrianglePacket());
+				node.packet_count++;
+				lane = 0;
+			}
+			const Triangle &tri = (*tris)[p->id];
+			packets.back().Set(lane++, tri.a, tri.edge_a, tri.edge_b, p->id);
+		}
+	}
+}
+
+void BVH::Subdivide(int node_id, int depth, vector<AABB> &bounds, vector<Vector> &centroids) {
+	const int first = nodes[node_id].left_first;
+	const int count = nodes[node_id].count;
+
+	AABB node_bounds, centroid_bounds;
+	for (int i = first; i < first + count; i++) {
+		node_bounds.Extend(bounds[i]);
+		centroid_bounds.Extend(centroids[i]);
+	}
+	nodes[node_id].bounds = node_bounds;
+
+	if (count <= 2 || depth >= BVH_MAX_DEPTH)
+		return;
+
+	/* Find best split plane over binned centroids of all three axes */
+	int best_axis = -1;
+	int best_bin = 0;
+	double best_cost = 1e30;
+	const double extent[3] = {
+		centroid_bounds.max.x - centroid_bounds.min.x,
+		centroid_bounds.max.y - centroid_bounds.min.y,
+		centroid_bounds.max.z - centroid_bounds.min.z };
+	const double origin[3] = {
+		centroid_bounds.min.x, centroid_bounds.min.y, centroid_bounds.min.z };
+
+	for (int axis = 0; axis < 3; axis++) {
+		if (extent[axis] <= 1e-12)
+			continue;
+
+		AABB bin_bounds[SAH_BINS];
+		int bin_count[SAH_BINS] = {0};
+		const double scale = SAH_BINS / extent[axis];
+
+		for (int i = first; i < first + count; i++) {
+			const double c = axis == 0 ? centroids[i].x :
+			                 axis == 1 ? centroids[i].y : centroids[i].z;
+			int b = min(SAH_BINS - 1, int((c - origin[axis]) * scale));
+			bin_count[b]++;
+			bin_bounds[b].Extend(bounds[i]);
+		}
+
+		/* Sweep from both sides to get areas and counts left/right of planes */
+		double left_area[SAH_BINS - 1], right_area[SAH_BINS - 1];
+		int left_count[SAH_BINS - 1], right_count[SAH_BINS - 1];
+		AABB left_box, right_box;
+		int left_sum = 0, right_sum = 0;
+		for (int b = 0; b < SAH_BINS - 1; b++) {
+			left_sum += bin_count[b];
+			left_count[b] = left_sum;
+			left_box.Extend(bin_bounds[b]);
+			left_area[b] = left_box.SurfaceArea();
+
+			right_sum += bin_count[SAH_BINS - 1 - b];
+			right_count[SAH_BINS - 2 - b] = right_sum;
+			right_box.Extend(bin_bounds[SAH_BINS - 1 - b]);
+			right_area[SAH_BINS - 2 - b] = right_box.SurfaceArea();
+		}
+
+		for (int b = 0; b < SAH_BINS - 1; b++) {
+			if (left_count[b] == 0 || right_count[b] == 0)
+				continue;
+			double cost = PacketCount(left_count[b]) * left_area[b] + 
+			              PacketCount(right_count[b]) * right_area[b];
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_bin = b;
+			}
+		}
+	}
+
+	if (best_axis < 0)
+		return;	/* All centroids coincide, keep as leaf */
+
+	/* Compare split cost against cost of intersecting all primitives */
+	const double parent_area = node_bounds.SurfaceArea();
+	const double split_cost = traversal_cost +
+		INTERSECTION_COST * best_cost / fmax(parent_area, 1e-30);
+	if (split_cost >= INTERSECTION_COST * PacketCount(count) && count <= max_leaf_size)
+		return;
+
+	/* Partition primitives in place */
+	const double scale = SAH_BINS / extent[best_axis];
+	int i = first;
+	int j = first + count - 1;
+	while (i <= j) {
+		const double c = best_axis == 0 ? centroids[i].x :
+		                 best_axis == 1 ? centroids[i].y : centroids[i].z;
+		int b = min(SAH_BINS - 1, int((c - origin[best_axis]) * scale));
+		if (b <= best_bin) {
+			i++;
+		} else {
+			swap(prims[i], prims[j]);
+			swap(bounds[i], bounds[j]);
+			swap(centroids[i], centroids[j]);
+			j--;
+		}
+	}
+
+	const int left_count = i - first;
+	if (left_count == 0 || left_count == count)
+		return;
+
+	const int left_id = nodes.size();
+	BVHNode left, right;
+	left.left_first = first;
+	left.count = left_count;
+	right.left_first = i;
+	right.count = count - left_count;
+	nodes.push_back(left);
+	nodes.push_back(right);
+
+	nodes[node_id].left_first = left_id;
+	nodes[node_id].count = 0;
+
+	Subdivide(left_id, depth + 1, bounds, centroids);
+	Subdivide(left_id + 1, depth + 1, bounds, centroids);
+}
+
+/* Closest-hit query; same contract as a linear test of all objects */
+bool BVH::Intersect(const Ray &ray, double &t, size_t &id, Type &type) const {
+	t = 1e20;
+	if (nodes.empty())
+		return false;
+
+	const Vector inv_dir(1.0 / ray.dir.x, 1.0 / ray.dir.y, 1.0 / ray.dir.z);
+	double t_box;
+	if (!nodes[0].bounds.Intersect(ray, inv_dir, t, t_box))
+		return false;
+
+	int stack[BVH_MAX_DEPTH + 1];
+	int stack_size = 0;
+	int node_id = 0;
+
+	while (true) {
+		const BVHNode &node = nodes[node_id];
+
+		if (node.count > 0) {
+			for (int i = node.left_first; i < node.left_first + node.count &&
+			     prims[i].type == SPH; i++) {
+				double d = (*spheres)[prims[i].id].Intersect(ray);
+				if (d > 0.0 && d < t) {
+					t = d;
+					id = prims[i].id;
+					type = SPH;
+				}
+			}
+			for (int k = node.packet_first; k < node.packet_first + node.packet_count; k++) {
+				int lane = IntersectPacket(packets[k], ray, t);
+				if (lane >= 0) {
+					id = packets[k].id[lane];
+					type = TRI;
+				}
+			}
+		} else {
+			/* Visit nearer child first, push the other one */
+			int near_id = node.left_first;
+			int far_id = node.left_first + 1;
+			double t_near, t_far;
+			bool hit_near = nodes[near_id].bounds.Intersect(ray, inv_dir, t, t_near);
+			bool hit_far = nodes[far_id].bounds.Intersect(ray, inv_dir, t, t_far);
+
+			if (hit_near && hit_far) {
+				if (t_far < t_near) {
+					swap(near_id, far_id);
+				}
+				stack[stack_size++] = far_id;
+				node_id = near_id;
+				continue;
+			} else if (hit_near) {
+				node_id = near_id;
+				continue;
+			} else if (hit_far) {
+				node_id = far_id;
+				continue;
+			}
+		}
+
+		if (stack_size == 0)
+			break;
+		node_id = stack[--stack_size];
+	}
+
+	return t < 1e20;
+}
+
+/* Any-hit query for shadow rays; true if something is hit before t_max */
+bool BVH::Occluded(const Ray &ray, double t_max) const {
+	if (nodes.empty())
+		return false;
+
+	const Vector inv_dir(1.0 / ray.dir.x, 1.0 / ray.dir.y, 1.0 / ray.dir.z);
+	double t_box;
+
+	int stack[BVH_MAX_DEPTH + 1];
+	int stack_size = 0;
+	stack[stack_size++] = 0;
+
+	while (stack_size > 0) {
+		const BVHNode &node = nodes[stack[--stack_size]];
+
+		if (!node.bounds.Intersect(ray, inv_dir, t_max, t_box))
+			continue;
+
+		if (node.count > 0) {
+			for (int i = node.left_first; i < node.left_first + node.count &&
+			     prims[i].type == SPH; i++) {
+				double d = (*spheres)[prims[i].id].Intersect(ray);
+				if (d > 0.0 && d < t_max)
+					return true;
+			}
+			for (int k = node.packet_first; k < node.packet_first + node.packet_count; k++) {
+				double t = t_max;
+				if (IntersectPacket(packets[k], ray, t) >= 0)
+					return true;
+			}
+		} else {
+			stack[stack_size++] = node.left_first + 1;
+			stack[stack_size++] = node.left_first;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,72 @@
+#ifndef _BVH_H_
+#define _BVH_H_
+
+#include "Geometry.hpp"
+#include "TriangleKernel.hpp"
+
+using namespace std;
+
+/* Axis-aligned bounding box */
+struct AABB {
+	Vector min, max;
+
+	AABB();
+
+	void Extend(const Vector &p);
+	void Extend(const AABB &b);
+	Vector Centroid() const;
+	double SurfaceArea() const;
+	bool Intersect(const Ray &ray, const Vector &inv_dir, double t_max,
+	               double &t_near) const;
+};
+
+/* Reference to a scene object stored in the hierarchy */
+struct Primitive {
+	Type type;
+	size_t id;
+};
+
+/* Maximum depth of the hierarchy; deeper nodes stay leaves even if
+   they are large (degenerate meshes), so the fixed-size traversal
+   stacks, which hold at most one entry per level plus one, suffice */
+#define BVH_MAX_DEPTH 64
+
+/* Node of the hierarchy; leaf if count > 0. Spheres of a leaf come
+   first in prims, its triangles are packed into SIMD packets. */
+struct BVHNode {
+	AABB bounds;
+	int left_first;			/* Index of left child, or first primitive of leaf */
+	int count;				/* Number of primitives in leaf */
+	int packet_first;		/* First triangle packet of leaf */
+	int packet_count;		/* Number of triangle packets in leaf */
+};
+
+/* Bounding volume hierarchy over the spheres and triangles of a
+   scene (either may be empty), built with the surface area heuristic.
+   Leaves hold at most max_leaf_size primitives unless splitting does
+   not pay off; traversal_cost is the cost of a traversal step
+   relative to one packet test. Renderers with few, large triangles
+   prefer big leaves (high traversal cost). */
+struct BVH {
+	vector<BVHNode> nodes;
+	vector<Primitive> prims;
+	vector<TrianglePacket> packets;
+	const vector<Sphere> *spheres;
+	const vector<Triangle> *tris;
+	int max_leaf_size;
+	double traversal_cost;
+
+	BVH(int max_leaf_size_ = 8, double traversal_cost_ = 1.0);
+
+	void Build(const vector<Sphere> &spheres_, const vector<Triangle> &tris_);
+	void Build(const vector<Triangle> &tris_);
+	bool Intersect(const Ray &ray, double &t, size_t &id, Type &type) const;
+	bool Occluded(const Ray &ray, double t_max) const;
+
+private:
+	AABB PrimitiveBounds(const Primitive &p) const;
+	void Subdivide(int node_id, int depth, vector<AABB> &bounds, vector<Vector> &centroids);
+	void BuildPackets();
+};
+
+#endif // _BVH_H_
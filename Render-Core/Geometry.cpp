@@ -0,0 +1,122 @@
+#include "Geometry.hpp"
+
+/*------------------------------------------------------------------
+| Scene objects can be triangles.
+------------------------------------------------------------------*/
+
+/* help function for triangle */
+double area_of_triangle(double a, double b, double c) {
+	double s = (a+b+c)/2;
+	return sqrt(s*(s-a)*(s-b)*(s-c));
+}
+
+/* function to calc normal for triangle */
+Vector calc_normal(Vector a, Vector b, Vector c){
+	Vector u = b - a;
+	Vector v = c - a;
+
+	return u.Cross(v);
+}
+
+Triangle::Triangle( const Vector p0_, const Vector &a_, const Vector &b_,
+					const Color &emission_, const Color &color_, Refl_t refl_) :
+	a(p0_), edge_a(a_), edge_b(b_), emission(emission_), color(color_), refl(refl_) {
+
+	b = a + edge_a;
+	c = a + edge_b;
+	normal = calc_normal(a, b, c).Normalized();
+	double a_to_b = (a - b).Length();
+	double a_to_c = (a - c).Length();
+	double b_to_c = (b - c).Length();
+	area = area_of_triangle(a_to_b, a_to_c, b_to_c);
+}
+
+Triangle::Triangle( Vector a_, Vector b_, Vector c_, Color color_, Refl_t refl_):
+	a(a_), b(b_), c(c_), color(color_), refl(refl_) {
+
+	edge_a = b - a;
+	edge_b = c - a;
+	emission = Color(0.0, 0.0, 0.0);
+	normal = calc_normal(a, b, c).Normalized();
+	area = area_of_triangle((a - b).Length(), (a - c).Length(), (b - c).Length());
+}
+
+/* Triangle-ray intersection test. */
+/* Implementation of the Möller-Trumbore intersection algorithm */
+/* based on wikipedia.org */
+double Triangle::intersect(const Ray &ray) const {
+
+	static const double EPSILON = 0.0000001;
+	const Vector &b_to_a = edge_a;
+	const Vector &c_to_a = edge_b;
+
+	Vector h = ray.dir.Cross(c_to_a);
+	double ax = b_to_a.Dot(h);
+
+	if (ax > -EPSILON && ax < EPSILON)
+		return 0.0;
+
+	double f = 1.0 / ax;
+	Vector s = ray.org - a;
+	double u = f * s.Dot(h);
+
+	if (u < 0.0 || u > 1.0)
+		return 0.0;
+
+	Vector q = s.Cross(b_to_a);
+	double v = f * ray.dir.Dot(q);
+
+	if (v < 0.0 || u + v > 1.0)
+		return 0.0;
+
+	double t = f * c_to_a.Dot(q);
+
+	if (t <= EPSILON)
+		return 0.0;
+
+	return t;
+}
+
+void Triangle::subdivide(Triangle t[4]) const {
+	t[0] = Triangle(a, (a + (edge_a / 2)) - a, (a + (edge_b / 2)) - a,
+		emission, color, refl);
+	t[1] = Triangle(t[0].b, b - t[0].b, (t[0].b + (edge_b / 2)) - t[0].b,
+		emission, color, refl);
+	t[2] = Triangle(t[1].c, t[0].c - t[1].c, t[1].a - t[1].c, emission, color, refl);
+	t[3] = Triangle(t[0].c, t[1].c - t[0].c, c - t[0].c, emission, color, refl);
+}
+
+/*------------------------------------------------------------------
+| Scene objects can be spheres. Material either perfectly diffuse,
+| specular (mirror reflection) or transparent (refraction/reflection)
+| (DIFFuse, SPECular, REFRactive).
+------------------------------------------------------------------*/
+
+Sphere::Sphere(double radius_, Vector position_, Vector emission_,
+				Vector color_, Refl_t refl_):
+	radius(radius_), position(position_), emission(emission_),
+	color(color_), refl(refl_) {}
+
+double Sphere::Intersect(const Ray &ray) const {
+	/* Check for ray-sphere intersection by solving for t:
+		t^2*d.d + 2*t*(o-p).d + (o-p).(o-p) - R^2 = 0 */
+	Vector op = position - ray.org;
+	double eps = 1e-4;
+	double b = op.Dot(ray.dir);
+	double radicant = b*b - op.Dot(op) + radius*radius;
+	if (radicant < 0.0)
+		return 0.0;		/* No intersection */
+	else
+		radicant = sqrt(radicant);
+
+	double t;
+	t = b - radicant;	/* Check smaller root first */
+	if(t > eps)
+		return t;
+
+	t = b + radicant;
+	if(t > eps)			/* Check second root */
+		return t;
+
+	return 0.0;			/* No intersection in ray direction */
+}
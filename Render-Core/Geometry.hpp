@@ -0,0 +1,49 @@
+#ifndef _GEOMETRY_H_
+#define _GEOMETRY_H_
+
+#include "Vector.hpp"
+
+using namespace std;
+
+/* Materials of all renderers: DIFFuse, SPECular, REFRactive, GLOSsy
+   and TRanSLucent for path tracing, Outer and Standard thin FILM for
+   thin-film interference; radiosity uses only DIFF */
+enum Refl_t { DIFF, SPEC, REFR, GLOS, TRSL, OFILM, SFILM };
+
+/* Kind of scene object hit by a ray */
+enum Type { TRI, SPH };
+
+double area_of_triangle(double a, double b, double c);
+Vector calc_normal(Vector a, Vector b, Vector c);
+
+struct Triangle {
+	Vector a, b, c;
+	Vector edge_a, edge_b;
+	Color emission, color;
+	Vector normal;
+	double area;
+	Refl_t refl;
+
+	Triangle( const Vector p0_, const Vector &a_, const Vector &b_,
+              const Color &emission_, const Color &color_, Refl_t refl_ = DIFF);
+    Triangle( Vector a_, Vector b_, Vector c_, Color color_, Refl_t refl_);
+
+    double intersect(const Ray &ray) const;
+
+    /* Split into 4 triangles at the edge midpoints */
+    void subdivide(Triangle children[4]) const;
+};
+
+struct Sphere {
+	double radius;
+    Vector position;
+    Color emission, color;
+    Refl_t refl;
+
+    Sphere(double radius_, Vector position_, Vector emission_,
+			Vector color_, Refl_t refl_);
+
+    double Intersect(const Ray &ray) const;
+};
+
+#endif // _GEOMETRY_H_
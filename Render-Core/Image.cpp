@@ -0,0 +1,114 @@
+#include <cstdint>
+
+#include "Image.hpp"
+
+/*------------------------------------------------------------------
+| Struct holds pixels/colors of rendered image.
+------------------------------------------------------------------*/
+
+Image::Image(int _w, int _h) : width(_w), height(_h) {
+	pixels = new Color[width * height];        
+}
+
+Color Image::getColor(int x, int y) {
+	int image_index = (height-y-1) * width + x;	
+	return pixels[image_index];
+}
+
+void Image::setColor(int x, int y, const Color &c) {
+	int image_index = (height-y-1) * width + x;	
+	pixels[image_index] = c;
+}
+
+void Image::addColor(int x, int y, const Color &c) {
+	int image_index = (height-y-1) * width + x;	
+	pixels[image_index] = pixels[image_index] + c;
+}
+
+/* Gamma corrected (1/2.2) 8 bit values for GAMMA_TABLE_SIZE values
+   evenly spaced in sqrt(x) over [0,1]; unlike linear spacing, this
+   follows the steep start of the gamma curve, so no dark code is
+   skipped */
+#define GAMMA_TABLE_SIZE 65536
+
+static vector<unsigned char> GammaTable() {
+	vector<unsigned char> table(GAMMA_TABLE_SIZE);
+	for (int i = 0; i < GAMMA_TABLE_SIZE; i++)
+		table[i] = (unsigned char)(pow(double(i) / (GAMMA_TABLE_SIZE - 1), 2/2.2) * 255 + .5);
+	return table;
+}
+
+bool Image::Save(const string &filename, int bits) {
+	static_assert(sizeof(Color) == 3 * sizeof(double), "Color must be three packed doubles");
+	
+	const size_t n = size_t(width) * height * 3;	/* Number of channel values */
+	const double *values = &pixels[0].x;
+	const bool pfm = filename.size() >= 4 && 
+	                 filename.compare(filename.size() - 4, 4, ".pfm") == 0;
+	
+	char header[64];
+	size_t header_size;
+	vector<unsigned char> data;
+	
+	if (pfm) {
+		/* Linear float PFM (little endian), rows from bottom to top */
+		header_size = snprintf(header, sizeof(header), "PF\n%d %d\n-1.0\n", width, height);
+		data.resize(header_size + n * sizeof(float));
+		float *out = (float *)(data.data() + header_size);
+		const int row_size = width * 3;
+		
+		#pragma omp parallel for schedule(static)
+		for (int y = 0; y < height; y++) {
+			const double *row = values + size_t(height - y - 1) * row_size;
+			float *out_row = out + size_t(y) * row_size;
+			for (int i = 0; i < row_size; i++)
+				out_row[i] = float(row[i]);
+		}
+	} else {
+		/* Binary PPM with 8 or 16 bit (big endian) gamma corrected values */
+		const size_t bytes = bits == 16 ? 2 : 1;
+		
+		header_size = snprintf(header, sizeof(header), "P6\n%d %d\n%d\n", width, height, 
+		                       bits == 16 ? 65535 : 255);
+		data.resize(header_size + n * bytes);
+		unsigned char *out = data.data() + header_size;
+		
+		/* Values are clamped to [0,1] (NaN becomes 0) branch-free */
+		if (bytes == 1) {
+			static const vector<unsigned char> gamma = GammaTable();
+			#pragma omp parallel for schedule(static)
+			for (size_t i = 0; i < n; i++) {
+				double x = values[i];
+				x = x > 0.0 ? x : 0.0;
+				x = x < 1.0 ? x : 1.0;
+				out[i] = gamma[int(sqrt(x) * (GAMMA_TABLE_SIZE - 1) + .5)];
+			}
+		} else {
+			/* A table fine enough for all 65536 dark codes would be too 
+			   large, so the gamma curve is evaluated per value */
+			#pragma omp parallel for schedule(static)
+			for (size_t i = 0; i < n; i++) {
+				double x = values[i];
+				x = x > 0.0 ? x : 0.0;
+				x = x < 1.0 ? x : 1.0;
+				const uint16_t v = uint16_t(pow(x, 1/2.2) * 65535 + .5);
+				out[2*i] = (unsigned char)(v >> 8);
+				out[2*i + 1] = (unsigned char)(v & 0xff);
+			}
+		}
+	}
+	memcpy(data.data(), header, header_size);
+	
+	/* Whole file in one write */
+	FILE *f = fopen(filename.c_str(), "wb");
+	if (!f) {
+		cerr << "Could not open " << filename << endl;
+		return false;
+	}
+	bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+	ok = fclose(f) == 0 && ok;
+	if (!ok)
+		cerr << "Could not write " << filename << endl;
+	return ok;
+}
+
@@ -0,0 +1,23 @@
+#ifndef _IMAGE_H_
+#define _IMAGE_H_
+
+#include <string>
+
+#include "Vector.hpp"
+
+using namespace std;
+
+struct Image {
+    int width, height;
+    Color *pixels;
+
+    Image(int _w, int _h);
+	Color getColor(int x, int y);
+    void setColor(int x, int y, const Color &c);
+    void addColor(int x, int y, const Color &c);
+    /* Saves binary PPM with 8 or 16 bits per channel, or linear
+       float PFM if the file name ends with .pfm; false on failure */
+    bool Save(const string &filename, int bits = 8);
+};
+
+#endif // _IMAGE_H_
@@ -1,7 +1,7 @@
 #ifndef _OBJREADER_H_
 #define _OBJREADER_H_
 
-#include "Structs.hpp"
+#include "Geometry.hpp"
 
 #include <sstream>
 
@@ -0,0 +1,33 @@
+#ifndef _RANDOM_H_
+#define _RANDOM_H_
+
+#include <cstdint>
+
+/* PCG32 random number generator (O'Neill, pcg-random.org). 
+   Every pixel (or other unit of work) gets its own generator, seeded
+   from its index, so the random sequence does not depend on which
+   thread draws the numbers or in which order. */
+struct RNG {
+	uint64_t state, inc;
+
+	RNG(uint64_t seed, uint64_t stream = 0) : state(0), inc((stream << 1u) | 1u) {
+		NextUInt();
+		state += seed;
+		NextUInt();
+	}
+
+	uint32_t NextUInt() {
+		uint64_t old = state;
+		state = old * 6364136223846793005ULL + inc;
+		uint32_t xorshifted = uint32_t(((old >> 18u) ^ old) >> 27u);
+		uint32_t rot = uint32_t(old >> 59u);
+		return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+	}
+
+	/* Uniform double in [0, 1) */
+	double Next() {
+		return NextUInt() * (1.0 / 4294967296.0);
+	}
+};
+
+#endif // _RANDOM_H_
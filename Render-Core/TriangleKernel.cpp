@@ -0,0 +1,272 @@
+#include "TriangleKernel.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNEL_X86
+#include <immintrin.h>
+#endif
+
+static const double EPSILON = 0.0000001;
+
+/*------------------------------------------------------------------
+| Packet of triangles in structure-of-arrays layout.
+------------------------------------------------------------------*/
+
+TrianglePacket::TrianglePacket() {
+	for (int i = 0; i < PACKET_WIDTH; i++) {
+		ax[i] = ay[i] = az[i] = 0.0;
+		e1x[i] = e1y[i] = e1z[i] = 0.0;
+		e2x[i] = e2y[i] = e2z[i] = 0.0;
+		id[i] = -1;
+	}
+}
+
+void TrianglePacket::Set(int lane, const Vector &a, const Vector &edge_a,
+                         const Vector &edge_b, int id_) {
+	ax[lane] = a.x; ay[lane] = a.y; az[lane] = a.z;
+	e1x[lane] = edge_a.x; e1y[lane] = edge_a.y; e1z[lane] = edge_a.z;
+	e2x[lane] = edge_b.x; e2y[lane] = edge_b.y; e2z[lane] = edge_b.z;
+	id[lane] = id_;
+}
+
+/*------------------------------------------------------------------
+| Scalar fallback; one lane after the other, same arithmetic as
+| Triangle::intersect().
+------------------------------------------------------------------*/
+
+int IntersectPacketScalar(const TrianglePacket &p, const Ray &ray, double &t) {
+	int hit = -1;
+
+	for (int i = 0; i < PACKET_WIDTH; i++) {
+		const double hx = ray.dir.y * p.e2z[i] - ray.dir.z * p.e2y[i];
+		const double hy = ray.dir.z * p.e2x[i] - ray.dir.x * p.e2z[i];
+		const double hz = ray.dir.x * p.e2y[i] - ray.dir.y * p.e2x[i];
+		const double det = p.e1x[i] * hx + p.e1y[i] * hy + p.e1z[i] * hz;
+
+		if (det > -EPSILON && det < EPSILON)
+			continue;
+
+		const double f = 1.0 / det;
+		const double sx = ray.org.x - p.ax[i];
+		const double sy = ray.org.y - p.ay[i];
+		const double sz = ray.org.z - p.az[i];
+		const double u = f * (sx * hx + sy * hy + sz * hz);
+
+		if (u < 0.0 || u > 1.0)
+			continue;
+
+		const double qx = sy * p.e1z[i] - sz * p.e1y[i];
+		const double qy = sz * p.e1x[i] - sx * p.e1z[i];
+		const double qz = sx * p.e1y[i] - sy * p.e1x[i];
+		const double v = f * (ray.dir.x * qx + ray.dir.y * qy + ray.dir.z * qz);
+
+		if (v < 0.0 || u + v > 1.0)
+			continue;
+
+		const double d = f * (p.e2x[i] * qx + p.e2y[i] * qy + p.e2z[i] * qz);
+
+		if (d > EPSILON && d < t) {
+			t = d;
+			hit = i;
+		}
+	}
+
+	return hit;
+}
+
+#ifdef KERNEL_X86
+
+/*------------------------------------------------------------------
+| SSE4 kernel; two lanes per register, two halves per packet.
+------------------------------------------------------------------*/
+
+__attribute__((target("sse4.1")))
+int IntersectPacketSSE4(const TrianglePacket &p, const Ray &ray, double &t) {
+	const __m128d eps = _mm_set1_pd(EPSILON);
+	const __m128d neg_eps = _mm_set1_pd(-EPSILON);
+	const __m128d zero = _mm_setzero_pd();
+	const __m128d one = _mm_set1_pd(1.0);
+	const __m128d dx = _mm_set1_pd(ray.dir.x);
+	const __m128d dy = _mm_set1_pd(ray.dir.y);
+	const __m128d dz = _mm_set1_pd(ray.dir.z);
+	const __m128d ox = _mm_set1_pd(ray.org.x);
+	const __m128d oy = _mm_set1_pd(ray.org.y);
+	const __m128d oz = _mm_set1_pd(ray.org.z);
+
+	alignas(16) double dist[PACKET_WIDTH];
+	int mask = 0;
+
+	for (int k = 0; k < PACKET_WIDTH; k += 2) {
+		const __m128d e1x = _mm_load_pd(p.e1x + k);
+		const __m128d e1y = _mm_load_pd(p.e1y + k);
+		const __m128d e1z = _mm_load_pd(p.e1z + k);
+		const __m128d e2x = _mm_load_pd(p.e2x + k);
+		const __m128d e2y = _mm_load_pd(p.e2y + k);
+		const __m128d e2z = _mm_load_pd(p.e2z + k);
+
+		const __m128d hx = _mm_sub_pd(_mm_mul_pd(dy, e2z), _mm_mul_pd(dz, e2y));
+		const __m128d hy = _mm_sub_pd(_mm_mul_pd(dz, e2x), _mm_mul_pd(dx, e2z));
+		const __m128d hz = _mm_sub_pd(_mm_mul_pd(dx, e2y), _mm_mul_pd(dy, e2x));
+		const __m128d det = _mm_add_pd(_mm_add_pd(_mm_mul_pd(e1x, hx),
+			_mm_mul_pd(e1y, hy)), _mm_mul_pd(e1z, hz));
+		__m128d valid = _mm_or_pd(_mm_cmple_pd(det, neg_eps), _mm_cmpge_pd(det, eps));
+
+		const __m128d f = _mm_div_pd(one, det);
+		const __m128d sx = _mm_sub_pd(ox, _mm_load_pd(p.ax + k));
+		const __m128d sy = _mm_sub_pd(oy, _mm_load_pd(p.ay + k));
+		const __m128d sz = _mm_sub_pd(oz, _mm_load_pd(p.az + k));
+		const __m128d u = _mm_mul_pd(f, _mm_add_pd(_mm_add_pd(_mm_mul_pd(sx, hx),
+			_mm_mul_pd(sy, hy)), _mm_mul_pd(sz, hz)));
+		valid = _mm_and_pd(valid, _mm_and_pd(_mm_cmpge_pd(u, zero), _mm_cmple_pd(u, one)));
+
+		const __m128d qx = _mm_sub_pd(_mm_mul_pd(sy, e1z), _mm_mul_pd(sz, e1y));
+		const __m128d qy = _mm_sub_pd(_mm_mul_pd(sz, e1x), _mm_mul_pd(sx, e1z));
+		const __m128d qz = _mm_sub_pd(_mm_mul_pd(sx, e1y), _mm_mul_pd(sy, e1x));
+		const __m128d v = _mm_mul_pd(f, _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, qx),
+			_mm_mul_pd(dy, qy)), _mm_mul_pd(dz, qz)));
+		valid = _mm_and_pd(valid, _mm_and_pd(_mm_cmpge_pd(v, zero),
+			_mm_cmple_pd(_mm_add_pd(u, v), one)));
+
+		const __m128d d = _mm_mul_pd(f, _mm_add_pd(_mm_add_pd(_mm_mul_pd(e2x, qx),
+			_mm_mul_pd(e2y, qy)), _mm_mul_pd(e2z, qz)));
+		valid = _mm_and_pd(valid, _mm_and_pd(_mm_cmpgt_pd(d, eps),
+			_mm_cmplt_pd(d, _mm_set1_pd(t))));
+
+		_mm_store_pd(dist + k, d);
+		mask |= _mm_movemask_pd(valid) << k;
+	}
+
+	int hit = -1;
+	for (int i = 0; i < PACKET_WIDTH; i++) {
+		if ((mask & (1 << i)) && dist[i] < t) {
+			t = dist[i];
+			hit = i;
+		}
+	}
+	return hit;
+}
+
+/*------------------------------------------------------------------
+| AVX2 kernel; all four lanes in one register.
+------------------------------------------------------------------*/
+
+__attribute__((target("avx2")))
+int IntersectPacketAVX2(const TrianglePacket &p, const Ray &ray, double &t) {
+	const __m256d eps = _mm256_set1_pd(EPSILON);
+	const __m256d neg_eps = _mm256_set1_pd(-EPSILON);
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256d dx = _mm256_set1_pd(ray.dir.x);
+	const __m256d dy = _mm256_set1_pd(ray.dir.y);
+	const __m256d dz = _mm256_set1_pd(ray.dir.z);
+
+	const __m256d e1x = _mm256_load_pd(p.e1x);
+	const __m256d e1y = _mm256_load_pd(p.e1y);
+	const __m256d e1z = _mm256_load_pd(p.e1z);
+	const __m256d e2x = _mm256_load_pd(p.e2x);
+	const __m256d e2y = _mm256_load_pd(p.e2y);
+	const __m256d e2z = _mm256_load_pd(p.e2z);
+
+	const __m256d hx = _mm256_sub_pd(_mm256_mul_pd(dy, e2z), _mm256_mul_pd(dz, e2y));
+	const __m256d hy = _mm256_sub_pd(_mm256_mul_pd(dz, e2x), _mm256_mul_pd(dx, e2z));
+	const __m256d hz = _mm256_sub_pd(_mm256_mul_pd(dx, e2y), _mm256_mul_pd(dy, e2x));
+	const __m256d det = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(e1x, hx),
+		_mm256_mul_pd(e1y, hy)), _mm256_mul_pd(e1z, hz));
+	__m256d valid = _mm256_or_pd(_mm256_cmp_pd(det, neg_eps, _CMP_LE_OQ),
+		_mm256_cmp_pd(det, eps, _CMP_GE_OQ));
+	if (_mm256_movemask_pd(valid) == 0)
+		return -1;
+
+	const __m256d f = _mm256_div_pd(one, det);
+	const __m256d sx = _mm256_sub_pd(_mm256_set1_pd(ray.org.x), _mm256_load_pd(p.ax));
+	const __m256d sy = _mm256_sub_pd(_mm256_set1_pd(ray.org.y), _mm256_load_pd(p.ay));
+	const __m256d sz = _mm256_sub_pd(_mm256_set1_pd(ray.org.z), _mm256_load_pd(p.az));
+	const __m256d u = _mm256_mul_pd(f, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(sx, hx),
+		_mm256_mul_pd(sy, hy)), _mm256_mul_pd(sz, hz)));
+	valid = _mm256_and_pd(valid, _mm256_and_pd(_mm256_cmp_pd(u, zero, _CMP_GE_OQ),
+		_mm256_cmp_pd(u, one, _CMP_LE_OQ)));
+
+	const __m256d qx = _mm256_sub_pd(_mm256_mul_pd(sy, e1z), _mm256_mul_pd(sz, e1y));
+	const __m256d qy = _mm256_sub_pd(_mm256_mul_pd(sz, e1x), _mm256_mul_pd(sx, e1z));
+	const __m256d qz = _mm256_sub_pd(_mm256_mul_pd(sx, e1y), _mm256_mul_pd(sy, e1x));
+	const __m256d v = _mm256_mul_pd(f, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, qx),
+		_mm256_mul_pd(dy, qy)), _mm256_mul_pd(dz, qz)));
+	valid = _mm256_and_pd(valid, _mm256_and_pd(_mm256_cmp_pd(v, zero, _CMP_GE_OQ),
+		_mm256_cmp_pd(_mm256_add_pd(u, v), one, _CMP_LE_OQ)));
+
+	const __m256d d = _mm256_mul_pd(f, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(e2x, qx),
+		_mm256_mul_pd(e2y, qy)), _mm256_mul_pd(e2z, qz)));
+	valid = _mm256_and_pd(valid, _mm256_and_pd(_mm256_cmp_pd(d, eps, _CMP_GT_OQ),
+		_mm256_cmp_pd(d, _mm256_set1_pd(t), _CMP_LT_OQ)));
+
+	const int mask = _mm256_movemask_pd(valid);
+	if (mask == 0)
+		return -1;
+
+	alignas(32) double dist[PACKET_WIDTH];
+	_mm256_store_pd(dist, d);
+
+	int hit = -1;
+	for (int i = 0; i < PACKET_WIDTH; i++) {
+		if ((mask & (1 << i)) && dist[i] < t) {
+			t = dist[i];
+			hit = i;
+		}
+	}
+	return hit;
+}
+
+#else
+
+/* Other architectures only provide the scalar kernel */
+int IntersectPacketSSE4(const TrianglePacket &p, const Ray &ray, double &t) {
+	return IntersectPacketScalar(p, ray, t);
+}
+
+int IntersectPacketAVX2(const TrianglePacket &p, const Ray &ray, double &t) {
+	return IntersectPacketScalar(p, ray, t);
+}
+
+#endif
+
+/*------------------------------------------------------------------
+| Runtime selection of the kernel for the running CPU.
+------------------------------------------------------------------*/
+
+bool KernelSupported(KernelIsa isa) {
+#ifdef KERNEL_X86
+	__builtin_cpu_init();
+	if (isa == ISA_AVX2)
+		return __builtin_cpu_supports("avx2");
+	if (isa == ISA_SSE4)
+		return __builtin_cpu_supports("sse4.1");
+	return true;
+#else
+	return isa == ISA_SCALAR;
+#endif
+}
+
+KernelIsa BestKernelIsa() {
+	if (KernelSupported(ISA_AVX2))
+		return ISA_AVX2;
+	if (KernelSupported(ISA_SSE4))
+		return ISA_SSE4;
+	return ISA_SCALAR;
+}
+
+PacketKernel GetPacketKernel(KernelIsa isa) {
+	switch (isa) {
+		case ISA_AVX2: return IntersectPacketAVX2;
+		case ISA_SSE4: return IntersectPacketSSE4;
+		default:       return IntersectPacketScalar;
+	}
+}
+
+const char *KernelName(KernelIsa isa) {
+	switch (isa) {
+		case ISA_AVX2: return "AVX2";
+		case ISA_SSE4: return "SSE4";
+		default:       return "scalar";
+	}
+}
+
+PacketKernel IntersectPacket = GetPacketKernel(BestKernelIsa());
@@ -0,0 +1,44 @@
+#ifndef _TRIANGLEKERNEL_H_
+#define _TRIANGLEKERNEL_H_
+
+#include "Vector.hpp"
+
+using namespace std;
+
+#define PACKET_WIDTH 4
+
+/* PACKET_WIDTH triangles in structure-of-arrays layout, given by
+   vertex a and edges b - a, c - a. Unused lanes have zero edges
+   and id -1, so they never report a hit. */
+struct alignas(32) TrianglePacket {
+	double ax[PACKET_WIDTH], ay[PACKET_WIDTH], az[PACKET_WIDTH];
+	double e1x[PACKET_WIDTH], e1y[PACKET_WIDTH], e1z[PACKET_WIDTH];
+	double e2x[PACKET_WIDTH], e2y[PACKET_WIDTH], e2z[PACKET_WIDTH];
+	int id[PACKET_WIDTH];
+
+	TrianglePacket();
+
+	void Set(int lane, const Vector &a, const Vector &edge_a,
+	         const Vector &edge_b, int id_);
+};
+
+enum KernelIsa { ISA_SCALAR, ISA_SSE4, ISA_AVX2 };
+
+/* Tests one ray against all lanes of a packet (Möller-Trumbore).
+   Returns the lane of the closest hit nearer than t and updates t,
+   or -1 if no lane is hit. */
+typedef int (*PacketKernel)(const TrianglePacket &p, const Ray &ray, double &t);
+
+int IntersectPacketScalar(const TrianglePacket &p, const Ray &ray, double &t);
+int IntersectPacketSSE4(const TrianglePacket &p, const Ray &ray, double &t);
+int IntersectPacketAVX2(const TrianglePacket &p, const Ray &ray, double &t);
+
+bool KernelSupported(KernelIsa isa);
+KernelIsa BestKernelIsa();
+PacketKernel GetPacketKernel(KernelIsa isa);
+const char *KernelName(KernelIsa isa);
+
+/* Kernel for the best instruction set of the running CPU */
+extern PacketKernel IntersectPacket;
+
+#endif // _TRIANGLEKERNEL_H_
@@ -0,0 +1,84 @@
+#include "Vector.hpp"
+
+/*------------------------------------------------------------------
+| Struct for standard vector operations in 3D
+| (used for points, vectors, and colors).
+------------------------------------------------------------------*/
+
+Vector::Vector(double x_, double y_, double z_) : x(x_), y(y_), z(z_) {}
+
+Vector Vector::operator+(const Vector &b) const {
+	return Vector(x + b.x, y + b.y, z + b.z);
+}
+
+Vector Vector::operator-(const Vector &b) const {
+    return Vector(x - b.x, y - b.y, z - b.z);
+}
+
+Vector Vector::operator/(double c) const {
+	return Vector(x / c, y / c, z / c);
+}
+
+Vector Vector::operator*(double c) const {
+    return Vector(x * c, y * c, z * c);
+}
+
+Vector Vector::MultComponents(const Vector &b) const {
+	return Vector(x * b.x, y * b.y, z * b.z);
+}
+
+double Vector::LengthSquared() const {
+	return x*x + y*y + z*z;
+}
+
+double Vector::Length() const {
+	return sqrt(LengthSquared());
+}
+
+Vector Vector::Normalized() const {
+	return Vector(x, y, z) / sqrt(x*x + y*y + z*z);
+}
+
+double Vector::Dot(const Vector &b) const {
+    return x * b.x + y * b.y + z * b.z;
+}
+
+Vector Vector::Cross(const Vector &b) const {
+	return Vector((y * b.z) - (z * b.y),
+				  (z * b.x) - (x * b.z),
+                  (x * b.y) - (y * b.x));
+}
+
+Vector Vector::Invert() const {
+	return Vector(-x, -y, -z);
+}
+
+bool Vector::Equals(const Vector &b) const {
+	if(x == b.x && y == b.y && z == b.z){
+		return true;
+	} else {
+		return false;
+	}
+}
+
+double Vector::Max() {
+	return fmax(x, fmax(x, y));
+}
+
+Vector& Vector::clamp() {
+	x = x<0 ? 0.0 : x>1.0 ? 1.0 : x;
+	y = y<0 ? 0.0 : y>1.0 ? 1.0 : y;
+	z = z<0 ? 0.0 : z>1.0 ? 1.0 : z;
+	return *this;
+}
+
+Vector Vector::Interpolate(double alpha, const Vector &b) const {
+	return Vector((x*alpha + b.x*(1-alpha)), (y*alpha + b.y*(1-alpha)),
+			(z*alpha + b.z*(1-alpha))) / 2;
+}
+
+/*------------------------------------------------------------------
+| Structure for rays (e.g. viewing ray, ray tracing).
+------------------------------------------------------------------*/
+
+Ray::Ray(const Vector org_, const Vector &dir_) : org(org_), dir(dir_) {}
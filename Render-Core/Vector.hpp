@@ -0,0 +1,49 @@
+#ifndef _VECTOR_H_
+#define _VECTOR_H_
+
+/* Standard includes */
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+/* Trivially copyable (implicit copy constructor and assignment), so
+   copies of vectors and arrays of them compile to plain moves */
+struct Vector {
+
+    double x, y, z;			/* Position XYZ or color RGB */
+
+    Vector(double x_=0, double y_=0, double z_=0);
+
+    Vector operator+(const Vector &b) const;
+    Vector operator-(const Vector &b) const;
+    Vector operator/(double c) const;
+    Vector operator*(double c) const;
+    friend Vector operator*(double c, const Vector &b) {
+        return b * c;
+    }
+    Vector MultComponents(const Vector &b) const;
+    double LengthSquared() const;
+    double Length() const;
+	Vector Normalized() const;
+	double Dot(const Vector &b) const;
+	Vector Cross(const Vector &b) const;
+	Vector Invert() const;
+	bool Equals(const Vector &b) const;
+	double Max();
+    Vector& clamp();
+    Vector Interpolate(double alpha, const Vector &b) const;
+};
+
+typedef Vector Color;
+
+struct Ray {
+	Vector org, dir;		/* Origin and direction */
+	Ray(const Vector org_, const Vector &dir_);
+};
+
+#endif // _VECTOR_H_
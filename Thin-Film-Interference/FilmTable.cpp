@@ -0,0 +1,103 @@
+#include "FilmTable.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#define TABLE_MAGIC "FILMTB01"
+
+struct TableHeader {
+	char magic[8];
+	double n_film;
+	double thickness;
+	int32_t cos_steps;
+	int32_t lambda_steps;
+};
+
+FilmTable::FilmTable() : n_film(1.0), thickness(0.0), cos_steps(0), lambda_steps(0) {}
+
+void FilmTable::Build(double n_film_, double thickness_, int cos_steps_, int lambda_steps_) {
+	n_film = n_film_;
+	thickness = thickness_;
+	cos_steps = cos_steps_;
+	lambda_steps = lambda_steps_;
+	reflectance.resize(size_t(cos_steps) * lambda_steps);
+
+	for (int i = 0; i < cos_steps; i++) {
+		const double cos_theta = double(i) / (cos_steps - 1);
+		for (int j = 0; j < lambda_steps; j++) {
+			const double lambda = LAMBDA_MIN + (LAMBDA_MAX - LAMBDA_MIN) * j / (lambda_steps - 1);
+			reflectance[size_t(i) * lambda_steps + j] =
+				ThinFilmReflectance(cos_theta, lambda, n_film, thickness);
+		}
+	}
+}
+
+bool FilmTable::Save(const string &filename) const {
+	TableHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TABLE_MAGIC, sizeof(header.magic));
+	header.n_film = n_film;
+	header.thickness = thickness;
+	header.cos_steps = cos_steps;
+	header.lambda_steps = lambda_steps;
+
+	const string temp = filename + ".tmp";
+	FILE *f = fopen(temp.c_str(), "wb");
+	if (!f) {
+		cerr << "Could not write film table " << temp << endl;
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+	          fwrite(reflectance.data(), sizeof(float), reflectance.size(), f) == reflectance.size();
+	ok = fclose(f) == 0 && ok;
+
+	if (!ok || rename(temp.c_str(), filename.c_str()) != 0) {
+		cerr << "Could not write film table " << filename << endl;
+		remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool FilmTable::Load(const string &filename, double n_film_, double thickness_,
+                     int cos_steps_, int lambda_steps_) {
+	FILE *f = fopen(filename.c_str(), "rb");
+	if (!f)
+		return false;
+
+	TableHeader header;
+	bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+	          memcmp(header.magic, TABLE_MAGIC, sizeof(header.magic)) == 0 &&
+	          header.n_film == n_film_ && header.thickness == thickness_ &&
+	          header.cos_steps == cos_steps_ && header.lambda_steps == lambda_steps_;
+	if (ok) {
+		vector<float> values(size_t(cos_steps_) * lambda_steps_);
+		ok = fread(values.data(), sizeof(float), values.size(), f) == values.size();
+		if (ok) {
+			n_film = n_film_;
+			thickness = thickness_;
+			cos_steps = cos_steps_;
+			lambda_steps = lambda_steps_;
+			reflectance.swap(values);
+		}
+	}
+	fclose(f);
+	return ok;
+}
+
+double FilmTable::Reflectance(double cos_theta, double lambda) const {
+	/* Continuous table coordinates, clamped to the table */
+	const double x = fmin(fmax(fabs(cos_theta), 0.0), 1.0) * (cos_steps - 1);
+	const double y = fmin(fmax((lambda - LAMBDA_MIN) / (LAMBDA_MAX - LAMBDA_MIN), 0.0), 1.0) *
+	                 (lambda_steps - 1);
+	const int i = min(int(x), cos_steps - 2);
+	const int j = min(int(y), lambda_steps - 2);
+	const double fx = x - i;
+	const double fy = y - j;
+
+	const float *row = &reflectance[size_t(i) * lambda_steps + j];
+	const double r0 = row[0] + (row[1] - row[0]) * fy;
+	const double r1 = row[lambda_steps] + (row[lambda_steps + 1] - row[lambda_steps]) * fy;
+	return r0 + (r1 - r0) * fx;
+}
@@ -0,0 +1,44 @@
+#ifndef _FILMTABLE_H_
+#define _FILMTABLE_H_
+
+#include <string>
+#include <vector>
+
+#include "Spectrum.hpp"
+
+using namespace std;
+
+/* Default resolution: 1 nm in wavelength, the Airy fringes are tens
+   of nm apart for films below a few micrometers */
+#define FILM_TABLE_COS 256
+#define FILM_TABLE_LAMBDA 401
+
+/* Reflectance of a thin film tabulated over the cosine of the
+   incident angle [0, 1] and the wavelength [LAMBDA_MIN, LAMBDA_MAX],
+   read with bilinear interpolation. The film absorbs nothing, so
+   the transmittance is 1 - reflectance. */
+struct FilmTable {
+	double n_film;
+	double thickness;
+	int cos_steps;
+	int lambda_steps;
+	vector<float> reflectance;		/* cos_steps rows of lambda_steps values */
+
+	FilmTable();
+
+	void Build(double n_film_, double thickness_,
+	           int cos_steps_ = FILM_TABLE_COS, int lambda_steps_ = FILM_TABLE_LAMBDA);
+
+	/* Cache file of the table; Load() fails if the file is missing or
+	   was written for other film parameters or resolution */
+	bool Save(const string &filename) const;
+	bool Load(const string &filename, double n_film_, double thickness_,
+	          int cos_steps_ = FILM_TABLE_COS, int lambda_steps_ = FILM_TABLE_LAMBDA);
+
+	double Reflectance(double cos_theta, double lambda) const;
+	double Transmittance(double cos_theta, double lambda) const {
+		return 1.0 - Reflectance(cos_theta, lambda);
+	}
+};
+
+#endif // _FILMTABLE_H_
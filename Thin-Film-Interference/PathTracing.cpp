@@ -29,6 +29,10 @@
 
 #include "Structs.hpp"
 #include "OBJReader.hpp"
+#include "BVH.hpp"
+#include "Random.hpp"
+#include "Spectrum.hpp"
+#include "FilmTable.hpp"
 
 using namespace std;
 
@@ -36,6 +40,13 @@ using namespace std;
 #define film_diameter 0.05
 #define film_refraction_index 1.8
 
+/* Film thickness in nm for the spectral mode; the film_diameter of
+   the scene is taken in units of 10 micrometers (0.05 -> 500 nm) */
+double film_thickness = film_diameter * 10000.0;
+
+/* Film reflectance over (cos theta, lambda), built at scene load */
+FilmTable film_table;
+
 /******************************************************************
 * Hard-coded scene definition: The geometry is composed of spheres
 * and triangles.
@@ -68,33 +79,24 @@ vector<Triangle> goat =
 	translateOBJ(scaleOBJ(loadOBJ("goat.obj", Color(0.75, 0.75, 0.75)*0.999, DIFF), 0.08), 
 	Vector(40.0, 0.0, 80.0));
 
+/* Bounding volume hierarchy over spheres and triangles, built in main().
+   Large leaves and a high traversal cost keep the small box scene in
+   one leaf, whose triangles are tested packet-wise; loaded meshes 
+   still get a tree */
+#define BVH_MAX_LEAF_SIZE 32
+#define BVH_TRAVERSAL_COST 4.0
+
+BVH bvh(BVH_MAX_LEAF_SIZE, BVH_TRAVERSAL_COST);
+
 /******************************************************************
 * Check for closest intersection of a ray with the scene.
 * Returns true if intersection is found, as well as ray parameter
 * of intersection and id of intersected object.
+* Traverses the BVH, so cost per ray is logarithmic in the number
+* of scene objects.
 *******************************************************************/
 bool intersectScene(const Ray &ray, double &t, size_t &id, Type &type) {
-    t = 1e20;
-	
-	/* Check for intersection with spheres in scene. */
-    for (size_t i = 0; i < spheres.size(); i ++) {
-        double d = spheres[i].Intersect(ray);
-        if (d > 0.0  && d < t) {
-            t = d;
-            id = i;
-            type = SPH;
-        }
-    }
-    /* Check for intersection with triangles in scene. */
-    for (size_t i = 0; i < tris.size(); i ++) {
-        double d = tris[i].intersect(ray);
-        if (d > 0.0 && d < t) {
-            t  = d;
-            id = i;
-            type = TRI;
-        }
-    }
-    return t < 1e20;
+    return bvh.Intersect(ray, t, id, type);
 }
 
 /******************************************************************
@@ -102,15 +104,15 @@ bool intersectScene(const Ray &ray, double &t, size_t &id, Type &type) {
 * an angle. Used for computation of glossy and translucent 
 * materials in Radiance function.
 *******************************************************************/
-Vector sampleVector(Vector vec, double max_angle) {
+Vector sampleVector(Vector vec, double max_angle, RNG &rng) {
 	Vector sw = vec;
 	Vector su = fabs(sw.x) > 0.1 ? Vector(0.0, 1.0, 0.0) : Vector(1.0, 0.0, 0.0);
 	su = (su.Cross(sw)).Normalized();
 	Vector sv = sw.Cross(su);
 	
 	double cos_a_max = max_angle;
-	double eps1 = drand48();
-	double eps2 = drand48();
+	double eps1 = rng.Next();
+	double eps2 = rng.Next();
 	double cos_a = 1.0 - eps1 + eps1 * cos_a_max;
 	double sin_a = sqrt(1.0 - cos_a * cos_a);
 	double phi = 2.0*M_PI * eps2;
@@ -120,6 +122,17 @@ Vector sampleVector(Vector vec, double max_angle) {
 	return l.Normalized();
 }
 
+/* Closest hit of a ray with the scene */
+struct SceneHit {
+    double t;
+    size_t id;
+    Type type;
+    Vector hitpoint, normal;
+};
+
+Color RadianceAtHit(const Ray &ray, const SceneHit &hit, int depth, int E, bool notInFilm, 
+                    Wave wave, RNG &rng);
+
 /******************************************************************
 * Recursive path tracing for computing radiance via Monte-Carlo
 * integration, considering diffuse or thin film materials.
@@ -130,29 +143,51 @@ Vector sampleVector(Vector vec, double max_angle) {
 * is employed.
 * A more detailed explaination is to be found in the README.
 *******************************************************************/
-Color Radiance(const Ray &ray, int depth, int E, bool notInFilm, Wave wave) {
+Color Radiance(const Ray &ray, int depth, int E, bool notInFilm, Wave wave, RNG &rng) {
     depth++;
 
-    double t;                               
-    size_t id = 0; 
-    Type description_type; 
+    SceneHit hit;
+    hit.id = 0;
     
-    if (!intersectScene(ray, t, id, description_type)) {
+    if (!intersectScene(ray, hit.t, hit.id, hit.type)) {
         return Color(0.0, 0.0, 0.0); 
 	}
 	
-	bool isSphere = description_type == SPH ? true : false;
+	/* Intersection point and normal */
+	hit.hitpoint = ray.org + ray.dir * hit.t;
+	hit.normal = hit.type == SPH ? (hit.hitpoint - spheres[hit.id].position).Normalized() : 
+	                               tris[hit.id].normal;
 	
-	Sphere obj_s = isSphere ? spheres[id] : spheres[0];
-	Triangle obj_t = isSphere ? tris[0] : tris[id];
+	return RadianceAtHit(ray, hit, depth, E, notInFilm, wave, rng);
+}
+
+/******************************************************************
+* Continuation of a path at its hit with the scene. A bundled RGB
+* path splits here into one path per channel, which all continue 
+* from this hit instead of tracing the ray again.
+*******************************************************************/
+Color RadianceAtHit(const Ray &ray, const SceneHit &hit, int depth, int E, bool notInFilm, 
+                    Wave wave, RNG &rng) {
+	const size_t id = hit.id;
+	bool isSphere = hit.type == SPH ? true : false;
+	
+	const Sphere &obj_s = isSphere ? spheres[id] : spheres[0];
+	const Triangle &obj_t = isSphere ? tris[0] : tris[id];
 	
 	Color col = isSphere ? obj_s.color : obj_t.color;
 
-	/* Intersection point */
-    Vector hitpoint = ray.org + ray.dir * t;
-    
-    /* Calculate normals. */
-    Vector normal = isSphere ? (hitpoint - obj_s.position).Normalized() : obj_t.normal;
+	/* A bundled path carries all channels as long as it only meets 
+	   diffuse surfaces; the film is dispersive (refraction index 
+	   depends on the channel), so here the path splits into one 
+	   path per channel, each continuing from this hit */
+	if (wave == RGB && (isSphere ? obj_s.refl : obj_t.refl) != DIFF) {
+		return Color(RadianceAtHit(ray, hit, depth, E, notInFilm, R, rng).x,
+		             RadianceAtHit(ray, hit, depth, E, notInFilm, G, rng).y,
+		             RadianceAtHit(ray, hit, depth, E, notInFilm, B, rng).z);
+	}
+
+    const Vector &hitpoint = hit.hitpoint;
+    const Vector &normal = hit.normal;
     Vector nl = normal;
     if (normal.Dot(ray.dir) >= 0) 
         nl = nl.Invert();
@@ -161,7 +196,7 @@ Color Radiance(const Ray &ray, int depth, int E, bool notInFilm, Wave wave) {
     double p = col.Max();
     if (depth > 5 || !p) {  /* After 5 bounces or if max reflectivity is zero */
 	
-        if (drand48() < p)            /* Russian Roulette */
+        if (rng.Next() < p)            /* Russian Roulette */
             col = col * (1/p);        /* Scale estimator to remain unbiased */
         else 
 			/* No further bounces, only return potential emission */
@@ -171,8 +206,8 @@ Color Radiance(const Ray &ray, int depth, int E, bool notInFilm, Wave wave) {
      if ((isSphere ? obj_s.refl : obj_t.refl) == DIFF) {
 			                  
         /* Compute random reflection vector on hemisphere */
-        double r1 = 2.0 * M_PI * drand48(); 
-        double r2 = drand48(); 
+        double r1 = 2.0 * M_PI * rng.Next(); 
+        double r2 = rng.Next(); 
         double r2s = sqrt(r2); 
         
         /* Set up local orthogonal coordinate system u,v,w on surface */
@@ -201,13 +236,12 @@ Color Radiance(const Ray &ray, int depth, int E, bool notInFilm, Wave wave) {
                                (hitpoint - sphere.position).Dot(hitpoint-sphere.position));
             cos_a_max = cos_a_max != cos_a_max ? 1 : cos_a_max;
             
-            Vector l = sampleVector(sphere.position - hitpoint,	cos_a_max);
+            Vector l = sampleVector(sphere.position - hitpoint,	cos_a_max, rng);
 
-            /* Shoot shadow ray, check if intersection is with light source */
-            size_t index = id;
-            double t_;
-            Type temp_type;
-            if (intersectScene(Ray(hitpoint,l), t_, index, temp_type) && index == i) {
+            /* Shoot shadow ray, check if light source is hit and unoccluded */
+            Ray shadow_ray(hitpoint, l);
+            double t_light = sphere.Intersect(shadow_ray);
+            if (t_light > 0.0 && !bvh.Occluded(shadow_ray, t_light)) {
 					  
                 double omega = 2*M_PI * (1 - cos_a_max);
 
@@ -218,7 +252,7 @@ Color Radiance(const Ray &ray, int depth, int E, bool notInFilm, Wave wave) {
         /* Return potential light emission, direct lighting, and indirect lighting (via
            recursive call for Monte-Carlo integration */      
         return (isSphere ? obj_s.emission : obj_t.emission)
-			* E + e + col.MultComponents(Radiance(Ray(hitpoint,d), depth, 0, false, wave));
+			* E + e + col.MultComponents(Radiance(Ray(hitpoint,d), depth, 0, false, wave, rng));
 			
     }
     
@@ -228,13 +262,13 @@ Color Radiance(const Ray &ray, int depth, int E, bool notInFilm, Wave wave) {
     double nt = film_refraction_index;
 	
 	if (wave == R) {
-		double vr = drand48();
+		double vr = rng.Next();
 		nt = nt + 0.01 + (vr/10) - 0.02;
 	} else if (wave == G) {
-		double vg = drand48();
+		double vg = rng.Next();
 		nt = nt + 0.07 + (vg/10) - 0.02;
 	} else if (wave == B) {
-		double vb = drand48();
+		double vb = rng.Next();
 		nt = nt + 0.13 + (vb/10) - 0.02;
 	}
 	
@@ -266,21 +300,21 @@ Color Radiance(const Ray &ray, int depth, int E, bool notInFilm, Wave wave) {
     if ((isSphere ? obj_s.refl : obj_t.refl) == OFILM) {
 		if (cos2t < 0) {
 			return (isSphere ? obj_s.emission : obj_t.emission)
-				+ col.MultComponents(Radiance(Ray(hitpoint, tdir), depth, 1, false, wave) * 0.5
-				+ Radiance(Ray(inner_hitpoint2, inner_rdir2), depth, 1, false, wave) * 0.5);
+				+ col.MultComponents(Radiance(Ray(hitpoint, tdir), depth, 1, false, wave, rng) * 0.5
+				+ Radiance(Ray(inner_hitpoint2, inner_rdir2), depth, 1, false, wave, rng) * 0.5);
 		}
 		if (depth < 2) {
 			return (isSphere ? obj_s.emission : obj_t.emission)
-				+ col.MultComponents(Radiance(reflRay, depth, 1, false, wave) * 0.5 
-				+ Radiance(Ray(inner_hitpoint, inner_rdir), depth, 1, false, wave) * 0.5);
+				+ col.MultComponents(Radiance(reflRay, depth, 1, false, wave, rng) * 0.5 
+				+ Radiance(Ray(inner_hitpoint, inner_rdir), depth, 1, false, wave, rng) * 0.5);
 		} else {
-			if (drand48() < 0.5)
+			if (rng.Next() < 0.5)
 				return (isSphere ? obj_s.emission : obj_t.emission)
-					+ col.MultComponents(Radiance(reflRay, depth, 1, false, wave));
+					+ col.MultComponents(Radiance(reflRay, depth, 1, false, wave, rng));
 			else
 				return (isSphere ? obj_s.emission : obj_t.emission)
 					+ col.MultComponents(Radiance(Ray(inner_hitpoint, inner_rdir),
-					depth, 1, false, wave));
+					depth, 1, false, wave, rng));
 		}
 	}
     
@@ -293,29 +327,166 @@ Color Radiance(const Ray &ray, int depth, int E, bool notInFilm, Wave wave) {
     if (cos2t < 0) {
 		if (notInFilm) {
 			return (isSphere ? obj_s.emission : obj_t.emission)
-				+ col.MultComponents(Radiance(reflRay, depth, 1, false, wave));
+				+ col.MultComponents(Radiance(reflRay, depth, 1, false, wave, rng));
 		}
 		return (isSphere ? obj_s.emission : obj_t.emission)
-			+ col.MultComponents((Radiance(Ray(hitpoint, tdir), depth, 1, false, wave)
-			+ Radiance(Ray(inner_hitpoint2, inner_rdir2), depth, 1, false, wave)) * 0.5);
+			+ col.MultComponents((Radiance(Ray(hitpoint, tdir), depth, 1, false, wave, rng)
+			+ Radiance(Ray(inner_hitpoint2, inner_rdir2), depth, 1, false, wave, rng)) * 0.5);
  
 	} 
 	if (reflect) {  
 		return (isSphere ? obj_s.emission : obj_t.emission)
-			+ col.MultComponents(Radiance(reflRay, depth, 1, false, wave) * 0.5 
-			+ Radiance(Ray(inner_hitpoint, inner_rdir), depth, 1, false, wave) * 0.5);
+			+ col.MultComponents(Radiance(reflRay, depth, 1, false, wave, rng) * 0.5 
+			+ Radiance(Ray(inner_hitpoint, inner_rdir), depth, 1, false, wave, rng) * 0.5);
 	} else {
 		return (isSphere ? obj_s.emission : obj_t.emission)
-		+ col.MultComponents(Radiance(Ray(hitpoint, tdir), depth, 1, true, wave));
+		+ col.MultComponents(Radiance(Ray(hitpoint, tdir), depth, 1, true, wave, rng));
 	}
 }
 
 
+/******************************************************************
+* Spectral path tracing with hero wavelength sampling: every path
+* carries HERO_WAVELENGTHS wavelengths and returns the radiance for
+* each of them. Reflectances and emissions are RGB upsampled to 
+* spectra. At film surfaces the path is reflected or transmitted 
+* (unchanged direction, as for a thin film) with the probability 
+* given by the mean Airy reflectance of all carried wavelengths;
+* this is the balance heuristic over the sampling strategies of the
+* single wavelengths, so each of them is weighted by its own 
+* reflectance (transmittance) over that mean. The first FILM_SPLITS
+* film hits follow both branches instead, as the RGB mode does.
+* Radiance is added to L, weighted by the path throughput.
+*******************************************************************/
+
+#define FILM_SPLITS 2
+
+void SpectralRadiance(Ray ray, const double lambda[HERO_WAVELENGTHS], double throughput[HERO_WAVELENGTHS],
+                      int depth, bool add_emission, int splits, double L[HERO_WAVELENGTHS], RNG &rng) {
+    for (depth++; ; depth++) {
+        double t;
+        size_t id = 0;
+        Type type;
+        if (!intersectScene(ray, t, id, type))
+            break;
+
+        const bool isSphere = type == SPH;
+        const Color &col = isSphere ? spheres[id].color : tris[id].color;
+        const Color &emission = isSphere ? spheres[id].emission : tris[id].emission;
+        const Refl_t refl = isSphere ? spheres[id].refl : tris[id].refl;
+
+        const Vector hitpoint = ray.org + ray.dir * t;
+        const Vector normal = isSphere ? (hitpoint - spheres[id].position).Normalized() : 
+                                         tris[id].normal;
+        const Vector nl = normal.Dot(ray.dir) < 0 ? normal : normal * -1;
+
+        if (add_emission)
+            for (int k = 0; k < HERO_WAVELENGTHS; k++)
+                L[k] += throughput[k] * SpectrumFromRGB(emission, lambda[k]);
+
+        /* Russian Roulette after 5 bounces, shared by all wavelengths */
+        double p = 0.0;
+        for (int k = 0; k < HERO_WAVELENGTHS; k++)
+            p = fmax(p, throughput[k] * SpectrumFromRGB(col, lambda[k]));
+        p = fmin(p, 1.0);
+        if (depth > 5 || p <= 0.0) {
+            if (rng.Next() >= p)
+                break;
+            for (int k = 0; k < HERO_WAVELENGTHS; k++)
+                throughput[k] /= p;
+        }
+
+        if (refl == DIFF) {
+            /* Explicit direct lighting from the spherical light sources */
+            for (size_t i = 0; i < spheres.size(); i ++) {
+                const Sphere &sphere = spheres[i];
+                if (sphere.emission.x <= 0.0 && sphere.emission.y <= 0.0 && 
+                    sphere.emission.z <= 0.0)
+                    continue;
+
+                double cos_a_max = sqrt(1.0 - sphere.radius * sphere.radius / 
+                    (hitpoint - sphere.position).Dot(hitpoint - sphere.position));
+                cos_a_max = cos_a_max != cos_a_max ? 1 : cos_a_max;
+                const Vector l = sampleVector(sphere.position - hitpoint, cos_a_max, rng);
+
+                const Ray shadow_ray(hitpoint, l);
+                const double t_light = sphere.Intersect(shadow_ray);
+                if (l.Dot(nl) > 0.0 && t_light > 0.0 && !bvh.Occluded(shadow_ray, t_light)) {
+                    const double omega = 2 * M_PI * (1 - cos_a_max);
+                    const double weight = l.Dot(nl) * omega / M_PI;
+                    for (int k = 0; k < HERO_WAVELENGTHS; k++)
+                        L[k] += throughput[k] * SpectrumFromRGB(col, lambda[k]) * 
+                                SpectrumFromRGB(sphere.emission, lambda[k]) * weight;
+                }
+            }
+
+            /* Cosine-weighted diffuse bounce */
+            const double r1 = 2.0 * M_PI * rng.Next();
+            const double r2 = rng.Next();
+            const double r2s = sqrt(r2);
+            const Vector w = nl;
+            const Vector u = ((fabs(w.x) > 0.1 ? Vector(0.0, 1.0, 0.0) : 
+                                                 Vector(1.0, 0.0, 0.0)).Cross(w)).Normalized();
+            const Vector v = w.Cross(u);
+            const Vector d = (u * cos(r1) * r2s + v * sin(r1) * r2s + w * sqrt(1 - r2)).Normalized();
+
+            for (int k = 0; k < HERO_WAVELENGTHS; k++)
+                throughput[k] *= SpectrumFromRGB(col, lambda[k]);
+            ray = Ray(hitpoint, d);
+            add_emission = false;
+            continue;
+        }
+
+        const Vector reflected = ray.dir - normal * 2 * normal.Dot(ray.dir);
+        for (int k = 0; k < HERO_WAVELENGTHS; k++)
+            throughput[k] *= SpectrumFromRGB(col, lambda[k]);
+        add_emission = true;
+
+        if (refl == SPEC) {
+            ray = Ray(hitpoint, reflected);
+            continue;
+        }
+
+        /* Thin film: reflect or pass through */
+        const double cos_theta = ray.dir.Dot(nl) * -1;
+        double R[HERO_WAVELENGTHS];
+        double p_reflect = 0.0;
+        for (int k = 0; k < HERO_WAVELENGTHS; k++) {
+            R[k] = film_table.Reflectance(cos_theta, lambda[k]);
+            p_reflect += R[k] / HERO_WAVELENGTHS;
+        }
+
+        if (splits < FILM_SPLITS) {
+            double reflected_throughput[HERO_WAVELENGTHS];
+            for (int k = 0; k < HERO_WAVELENGTHS; k++) {
+                reflected_throughput[k] = throughput[k] * R[k];
+                throughput[k] *= 1.0 - R[k];
+            }
+            SpectralRadiance(Ray(hitpoint, reflected), lambda, reflected_throughput, 
+                             depth, true, splits + 1, L, rng);
+            ray = Ray(hitpoint, ray.dir);
+            splits++;
+        } else if (rng.Next() < p_reflect) {
+            for (int k = 0; k < HERO_WAVELENGTHS; k++)
+                throughput[k] *= R[k] / p_reflect;
+            ray = Ray(hitpoint, reflected);
+        } else {
+            for (int k = 0; k < HERO_WAVELENGTHS; k++)
+                throughput[k] *= (1.0 - R[k]) / (1.0 - p_reflect);
+            ray = Ray(hitpoint, ray.dir);
+        }
+    }
+}
+
+
 /******************************************************************
 * Main routine: Computation of path tracing image (2x2 subpixels).
 * Key parameters:
 * - Image dimensions: width, height 
 * - Number of samples per subpixel (non-uniform filtering): samples 
+* - Spectral rendering with hero wavelengths and Airy thin-film 
+*   reflectance: -spectral, film thickness -thickness nm (default 500)
+* - Directory caching the film reflectance table: -filmcache dir
 * Rendered result saved as PPM image file.
 *******************************************************************/
 
@@ -324,18 +495,47 @@ int main(int argc, char *argv[]) {
 	/* Add loaded obj to triangle-rendering-vector */
 	//for(Triangle t : goat) {tris.push_back(t);}
 	
+	/* Build acceleration structure once the scene is complete */
+	bvh.Build(spheres, tris);
+	
     int width = 1024;
     int height = 768;
     int samples = 1;
     bool thinLense = false;
-
-    if(argc == 2)
-        samples = atoi(argv[1]);  
-	else if(argc == 3) {
-		samples = atoi(argv[1]); 
-		thinLense = argv[2][0] == 't' ? true : false;
-	}
+    bool spectral = false;
+    string film_cache_dir;
+
+    /* Positional arguments: samples [thin]; options may appear anywhere */
+    int positional = 0;
+    for (int i = 1; i < argc; i ++) {
+        string arg = argv[i];
+        if (arg == "-spectral")
+            spectral = true;
+        else if (arg == "-thickness" && i + 1 < argc)
+            film_thickness = atof(argv[++i]);
+        else if (arg == "-filmcache" && i + 1 < argc)
+            film_cache_dir = argv[++i];
+        else if (positional++ == 0)
+            samples = atoi(argv[i]);
+        else
+            thinLense = argv[i][0] == 't' ? true : false;
+    }
     
+    /* Film reflectance table, taken from the cache if it was written
+       for the same film */
+    if (spectral) {
+        const string cache_file = film_cache_dir + "/film_" + 
+            to_string(film_refraction_index) + "_" + to_string(film_thickness) + ".table";
+        if (!film_cache_dir.empty() && 
+            film_table.Load(cache_file, film_refraction_index, film_thickness)) {
+            cout << "Film table loaded from " << cache_file << endl;
+        } else {
+            film_table.Build(film_refraction_index, film_thickness);
+            if (!film_cache_dir.empty() && film_table.Save(cache_file))
+                cout << "Film table saved to " << cache_file << endl;
+        }
+    }
+
     /* Set camera origin and viewing direction (negative z direction) */
     Ray camera(Vector(50.0, 52.0, 295.6), Vector(0.0, -0.042612, -1.0).Normalized());
 	
@@ -350,13 +550,15 @@ int main(int argc, char *argv[]) {
     for (int y = 0; y < height; y ++) {
 		 
         cout << "\rRendering (" << samples * 4 << " spp) " << (100.0 * y / (height - 1)) << "%     ";
-        srand(y * y * y);
  
         /* Loop over row pixels */
         #pragma omp parallel for
         for (int x = 0; x < width; x ++)  
         {
             img.setColor(x, y, Color());
+
+            /* Seeded by pixel, so the image does not depend on the threads */
+            RNG rng(uint64_t(y) * width + x);
  
             /* 2x2 subsampling per pixel */
             for (int sy = 0; sy < 2; sy ++) 
@@ -368,8 +570,8 @@ int main(int argc, char *argv[]) {
                     /* Compute radiance at subpixel using multiple samples */
                     for (int s = 0; s < samples; s ++) 
                     {
-                        const double r1 = 2.0 * drand48();
-                        const double r2 = 2.0 * drand48();
+                        const double r1 = 2.0 * rng.Next();
+                        const double r2 = 2.0 * rng.Next();
 
                         /* Transform uniform into non-uniform filter samples */
                         double dx;
@@ -394,11 +596,35 @@ int main(int argc, char *argv[]) {
 
                         dir = dir.Normalized();
 
-                        /* Accumulate radiance */
+                        if (spectral) {
+                            /* Hero wavelengths, uniform over the visible range;
+                               accumulate their estimates in XYZ */
+                            double lambda[HERO_WAVELENGTHS], L[HERO_WAVELENGTHS];
+                            double throughput[HERO_WAVELENGTHS];
+                            SampleWavelengths(rng.Next(), lambda);
+                            for (int k = 0; k < HERO_WAVELENGTHS; k++) {
+                                L[k] = 0.0;
+                                throughput[k] = 1.0;
+                            }
+                            SpectralRadiance(Ray(start, dir), lambda, throughput, 0, true, 0, L, rng);
+                            
+                            double xyz[3] = { 0.0, 0.0, 0.0 };
+                            for (int k = 0; k < HERO_WAVELENGTHS; k++) {
+                                double cmf[3];
+                                ColorMatching(lambda[k], cmf);
+                                for (int c = 0; c < 3; c++)
+                                    xyz[c] += L[k] * cmf[c] * 
+                                        (LAMBDA_MAX - LAMBDA_MIN) / HERO_WAVELENGTHS;
+                            }
+                            accumulated_radiance = accumulated_radiance + 
+                                RGBFromXYZ(xyz) / samples;
+                            continue;
+                        }
+
+                        /* Accumulate radiance; one path for all channels, 
+                           split only at film hits */
                         accumulated_radiance = accumulated_radiance + 
-                            Color(Radiance(Ray(start, dir), 0, 1, thinLense, R).x,
-								  Radiance(Ray(start, dir), 0, 1, thinLense, G).y,
-								  Radiance(Ray(start, dir), 0, 1, thinLense, B).z) / samples;
+                            Radiance(Ray(start, dir), 0, 1, thinLense, RGB, rng) / samples;
                     } 
                     
                     accumulated_radiance = accumulated_radiance.clamp() * 0.25;
@@ -410,5 +636,5 @@ int main(int argc, char *argv[]) {
     }
     cout << endl;
 
-    img.Save(string("image.ppm"));
+    return img.Save(string("image.ppm")) ? 0 : 1;
 }
@@ -0,0 +1,85 @@
+#include "Spectrum.hpp"
+
+void SampleWavelengths(double u, double lambda[HERO_WAVELENGTHS]) {
+	const double range = LAMBDA_MAX - LAMBDA_MIN;
+	for (int k = 0; k < HERO_WAVELENGTHS; k++) {
+		double offset = u * range + k * range / HERO_WAVELENGTHS;
+		if (offset >= range)
+			offset -= range;
+		lambda[k] = LAMBDA_MIN + offset;
+	}
+}
+
+/* Gaussian lobe with different widths left and right of its center,
+   given as inverse standard deviations */
+static double Lobe(double lambda, double mu, double inv_sigma_left, double inv_sigma_right) {
+	const double t = (lambda - mu) * (lambda < mu ? inv_sigma_left : inv_sigma_right);
+	return exp(-0.5 * t * t);
+}
+
+void ColorMatching(double lambda, double xyz[3]) {
+	xyz[0] = 1.056 * Lobe(lambda, 599.8, 0.0264, 0.0323) + 
+	         0.362 * Lobe(lambda, 442.0, 0.0624, 0.0374) - 
+	         0.065 * Lobe(lambda, 501.1, 0.0490, 0.0382);
+	xyz[1] = 0.821 * Lobe(lambda, 568.8, 0.0213, 0.0247) + 
+	         0.286 * Lobe(lambda, 530.9, 0.0613, 0.0322);
+	xyz[2] = 1.217 * Lobe(lambda, 437.0, 0.0845, 0.0278) + 
+	         0.681 * Lobe(lambda, 459.0, 0.0385, 0.0725);
+}
+
+double SpectrumFromRGB(const Color &c, double lambda) {
+	if (lambda < 490.0)
+		return c.z;
+	if (lambda < 590.0)
+		return c.y;
+	return c.x;
+}
+
+double ThinFilmReflectance(double cos_theta, double lambda, double n_film, double thickness) {
+	const double cos1 = fmin(fabs(cos_theta), 1.0);
+	const double sin1 = sqrt(1.0 - cos1 * cos1);
+	const double sin2 = sin1 / n_film;
+	const double cos2 = sqrt(1.0 - sin2 * sin2);
+	
+	/* Fresnel amplitude coefficients air -> film; film -> air has the
+	   opposite sign */
+	const double rs = (cos1 - n_film * cos2) / (cos1 + n_film * cos2);
+	const double rp = (n_film * cos1 - cos2) / (n_film * cos1 + cos2);
+	
+	/* Phase difference between successive internal reflections */
+	const double delta = 4.0 * M_PI * n_film * thickness * cos2 / lambda;
+	const double cos_delta = cos(delta);
+	
+	/* |r + r' e^(i delta)|^2 / |1 + r r' e^(i delta)|^2 with r' = -r */
+	double R = 0.0;
+	for (double r : { rs, rp }) {
+		const double r2 = r * r;
+		R += (2.0 * r2 - 2.0 * r2 * cos_delta) / (1.0 + r2 * r2 - 2.0 * r2 * cos_delta);
+	}
+	return 0.5 * R;
+}
+
+/* XYZ to linear sRGB (D65) */
+static Color LinearSRGB(const double xyz[3]) {
+	return Color( 3.2406 * xyz[0] - 1.5372 * xyz[1] - 0.4986 * xyz[2],
+	             -0.9689 * xyz[0] + 1.8758 * xyz[1] + 0.0415 * xyz[2],
+	              0.0557 * xyz[0] - 0.2040 * xyz[1] + 1.0570 * xyz[2]);
+}
+
+/* sRGB of the flat unit spectrum, integrated in 1 nm steps */
+static Color WhiteRGB() {
+	double xyz[3] = { 0.0, 0.0, 0.0 };
+	for (double lambda = LAMBDA_MIN + 0.5; lambda < LAMBDA_MAX; lambda += 1.0) {
+		double c[3];
+		ColorMatching(lambda, c);
+		for (int i = 0; i < 3; i++)
+			xyz[i] += c[i];
+	}
+	return LinearSRGB(xyz);
+}
+
+Color RGBFromXYZ(const double xyz[3]) {
+	static const Color white = WhiteRGB();
+	const Color rgb = LinearSRGB(xyz);
+	return Color(rgb.x / white.x, rgb.y / white.y, rgb.z / white.z);
+}
@@ -0,0 +1,37 @@
+#ifndef _SPECTRUM_H_
+#define _SPECTRUM_H_
+
+#include "Structs.hpp"
+
+using namespace std;
+
+/* Visible range sampled by the spectral mode, in nm */
+#define LAMBDA_MIN 380.0
+#define LAMBDA_MAX 780.0
+
+/* Wavelengths carried by one path: a uniformly sampled hero 
+   wavelength and its rotations by equal fractions of the range */
+#define HERO_WAVELENGTHS 8
+
+void SampleWavelengths(double u, double lambda[HERO_WAVELENGTHS]);
+
+/* CIE 1931 2 degree color matching functions, multi-lobe Gaussian fit
+   of Wyman, Sloan and Shirley, "Simple Analytic Approximations to the
+   CIE XYZ Color Matching Functions" (2013) */
+void ColorMatching(double lambda, double xyz[3]);
+
+/* Spectral value of an RGB reflectance or emission; box spectrum over 
+   the blue, green and red bands, so white stays flat */
+double SpectrumFromRGB(const Color &c, double lambda);
+
+/* Reflectance of a thin film with refraction index n_film and the
+   given thickness (nm) in air, for unpolarized light: Airy sum of 
+   all internal reflections, with the phase difference of the optical
+   path 2 * n_film * thickness * cos(theta_film) */
+double ThinFilmReflectance(double cos_theta, double lambda, double n_film, double thickness);
+
+/* Linear sRGB of an XYZ estimate, white balanced so that a flat unit
+   spectrum gives (1, 1, 1) */
+Color RGBFromXYZ(const double xyz[3]);
+
+#endif // _SPECTRUM_H_